@@ -0,0 +1,126 @@
+// Address-space identifiers (ASIDs) for user page tables.
+//
+// Each process runs with an ASID of its own in satp, so the
+// TLB can hold its translations alongside the kernel's (which
+// uses ASID 0) and other processes', and the trampoline need
+// not flush the TLB on every trap and return.
+//
+// ASIDs are handed out in order within a generation and never
+// reused inside it. When they run out, a new generation starts:
+// every process gets a fresh ASID the next time it returns to
+// user space, and every hart flushes its whole TLB before it
+// first runs a process with an ASID of the new generation.
+//
+// A process changes only its own page table, and flushes its
+// ASID on the hart it is running on. Other harts may still hold
+// stale entries for it, so p->asidcpu records the one hart known
+// to be up to date, and a process that returns to user space on
+// any other hart flushes its ASID there first.
+//
+// Without ASIDs (or with make NOASID=1) every process uses
+// ASID 0, and the trampoline flushes the TLB on each switch.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+static struct {
+  struct spinlock lock;
+  uint64 gen;    // current generation; never 0
+  uint next;     // next free ASID in this generation
+  uint max;      // largest ASID the hardware has; 0 if none
+} asids;
+
+// Find out how many ASID bits satp has.
+// Called once, on hart 0 with paging on.
+void
+asidinit(void)
+{
+  uint64 satp = r_satp();
+
+  initlock(&asids.lock, "asids");
+  asids.gen = 1;
+  asids.next = 1;
+
+  // the ASID field keeps only the bits the hardware implements.
+  w_satp(satp | SATP_ASIDMASK);
+  asids.max = (r_satp() & SATP_ASIDMASK) >> SATP_ASIDSHIFT;
+  w_satp(satp);
+  sfence_vma();
+#ifdef NOASID
+  asids.max = 0;
+#endif
+}
+
+// Make sure p has an ASID of the current generation, and that
+// this hart's TLB holds no stale entries for it.
+// Called on the way back to user space, with interrupts off.
+// Returns the ASID for p's satp.
+uint
+asidget(struct proc *p)
+{
+  struct cpu *c = mycpu();
+  int id = cpuid();
+  uint64 gen;
+
+  if(asids.max == 0)
+    return 0;
+
+  gen = __atomic_load_n(&asids.gen, __ATOMIC_ACQUIRE);
+  if(p->asidgen != gen){
+    acquire(&asids.lock);
+    if(asids.next > asids.max){
+      asids.gen++;
+      asids.next = 1;
+    }
+    p->asid = asids.next++;
+    p->asidgen = gen = asids.gen;
+    release(&asids.lock);
+    // unused so far in this generation, so nothing to flush
+    // on a hart that has started it.
+    p->asidcpu = id;
+  }
+
+  if(c->asidgen != gen){
+    sfence_vma();
+    c->asidgen = gen;
+    p->asidcpu = id;
+  } else if(p->asidcpu != id){
+    sfence_vma_asid(p->asid);
+    p->asidcpu = id;
+  }
+  return p->asid;
+}
+
+// Forget this hart's cached translations of pagetable,
+// after some of its PTEs have changed or gone away.
+// Only the running process's page table can be cached
+// under a live ASID, so others are left alone.
+void
+tlbflush(pagetable_t pagetable)
+{
+  tlbflushpage(pagetable, -1);
+}
+
+// Like tlbflush(), for the single page at va,
+// or for all of them if va is -1.
+void
+tlbflushpage(pagetable_t pagetable, uint64 va)
+{
+  struct proc *p = myproc();
+
+  if(asids.max == 0 || p == 0 || p->pagetable != pagetable || p->asidgen == 0)
+    return;
+  push_off();
+  if(va == -1)
+    sfence_vma_asid(p->asid);
+  else
+    sfence_vma_page(va, p->asid);
+  // this hart is now the only one known to be up to date.
+  p->asidcpu = cpuid();
+  pop_off();
+}
@@ -84,8 +84,8 @@ int
 consoleread(int user_dst, uint64 dst, int n)
 {
   uint target;
-  int c;
-  char cbuf;
+  int c, m = 0;
+  char buf[32];
 
   target = n;
   acquire(&cons.lock);
@@ -111,12 +111,7 @@ consoleread(int user_dst, uint64 dst, int n)
       break;
     }
 
-    // copy the input byte to the user-space buffer.
-    cbuf = c;
-    if(either_copyout(user_dst, dst, &cbuf, 1) == -1)
-      break;
-
-    dst++;
+    buf[m++] = c;
     --n;
 
     if(c == '\n'){
@@ -124,9 +119,22 @@ consoleread(int user_dst, uint64 dst, int n)
       // the user-level read().
       break;
     }
+
+    if(m == sizeof(buf)){
+      // either_copyout() may fault a page in and sleep,
+      // so copy the input to dst without cons.lock.
+      release(&cons.lock);
+      if(either_copyout(user_dst, dst, buf, m) == -1)
+        return target - n - m;
+      dst += m;
+      m = 0;
+      acquire(&cons.lock);
+    }
   }
   release(&cons.lock);
 
+  if(m > 0 && either_copyout(user_dst, dst, buf, m) == -1)
+    return target - n - m;
   return target - n;
 }
 
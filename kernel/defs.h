@@ -2,12 +2,22 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct kmem_cache;
+struct kmeminfo;
 struct pipe;
 struct proc;
 struct spinlock;
 struct sleeplock;
+struct slabinfo;
 struct stat;
 struct superblock;
+struct vma;
+
+// asid.c
+void            asidinit(void);
+uint            asidget(struct proc*);
+void            tlbflush(pagetable_t);
+void            tlbflushpage(pagetable_t, uint64);
 
 // bio.c
 void            binit(void);
@@ -55,10 +65,29 @@ int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
 void            ireclaim(int);
 
+// ksm.c
+void            ksminit(void);
+int             ksmscan(void);
+void            ksminfo(struct kmeminfo*);
+
+// oom.c
+void            oominit(void);
+void            oomkill(struct proc*);
+int             oomwait(struct proc*);
+void            oominfo(struct kmeminfo*);
+
 // kalloc.c
 void*           kalloc(void);
+void*           kalloc_order(int);
+void*           kalloc_zeroed(void);
 void            kfree(void *);
+void            kfree_order(void *, int);
+void            kshare(void *);
+int             krefs(void *);
 void            kinit(void);
+void            kmeminfo(struct kmeminfo*);
+void            kmemdrain(struct kmeminfo*);
+int             kzero_fill(void);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -66,7 +95,12 @@ void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
 
+// lz4.c
+int             lz4_compress(const uchar*, int, uchar*, int, ushort*);
+int             lz4_decompress(const uchar*, int, uchar*, int);
+
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
@@ -79,10 +113,10 @@ void            printfinit(void);
 
 // proc.c
 int             cpuid(void);
+int             ncpus(void);
 void            kexit(int);
 int             kfork(void);
 int             growproc(int);
-void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kkill(int);
@@ -90,7 +124,11 @@ int             killed(struct proc*);
 void            setkilled(struct proc*);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
+struct proc*    findproc(int, int);
 void            procinit(void);
+struct proc*    procfirst(void);
+struct proc*    procnext(struct proc*);
+void            proc_reclaim(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            sleep(void*, struct spinlock*);
@@ -108,6 +146,25 @@ void            mlfq_tick(void);
 int             getprocinfo(int, uint64);
 
 
+// swap.c
+void            swapinit(void);
+void            swapdup(uint);
+void            swapfree(uint);
+uint64          swapin(pagetable_t, uint64);
+int             swapreclaim(struct proc*);
+int             swappable(struct proc*, struct proc*);
+void            swapinfo(struct kmeminfo*);
+
+// zram.c
+void            zraminit(void);
+int             zramrefill(void*);
+int             zramput(void*);
+#define ZREJECT (-2)    // zramput(): the page doesn't compress well enough
+void            zramget(uint, void*);
+void            zramdup(uint);
+void            zramfree(uint);
+void            zraminfo(struct kmeminfo*);
+
 // swtch.S
 void            swtch(struct context*, struct context*);
 
@@ -116,9 +173,20 @@ void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
+int             tryacquire(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
 
+// slab.c
+void            slabinit(void);
+struct kmem_cache* kmem_cache_create(char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+void*           kmalloc(uint);
+void            kmfree(void*);
+int             slab_reclaim(void);
+int             slab_stats(int, struct slabinfo*);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
@@ -129,6 +197,7 @@ void            initsleeplock(struct sleeplock*, char*);
 int             memcmp(const void*, const void*, uint);
 void*           memmove(void*, const void*, uint);
 void*           memset(void*, int, uint);
+void            rvvinit(void);
 char*           safestrcpy(char*, const char*, int);
 int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
@@ -142,6 +211,13 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// textcache.c
+void            textinit(void);
+uint64          textget(struct vma*, uint64);
+void            textinval(struct inode*);
+int             textreclaim(void);
+int             textpages(void);
+
 // trap.c
 extern uint     ticks;
 void            trapinit(void);
@@ -160,21 +236,27 @@ int             uartgetc(void);
 void            kvminit(void);
 void            kvminithart(void);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
+uint64          kstackalloc(void);
+void            kstackfree(uint64);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 uint64          uvmalloc(pagetable_t, uint64, uint64, int);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmshare(pagetable_t, pagetable_t, uint64, uint64, int);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+void            uvmusage(pagetable_t, uint64*, uint64*, uint64*);
 pte_t *         walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
+uint64          vmprefault(pagetable_t, uint64, int);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
 int             ismapped(pagetable_t, uint64);
 uint64          vmfault(pagetable_t, uint64, int);
+void            thpinfo(struct kmeminfo*);
 
 // plic.c
 void            plicinit(void);
@@ -182,10 +264,24 @@ void            plicinithart(void);
 int             plic_claim(void);
 void            plic_complete(int);
 
+// vma.c
+struct vma*     vmalookup(struct proc*, uint64);
+int             vmaoverlaps(struct proc*, uint64, uint64);
+int             vmaread(struct vma*, uint64, char*);
+uint64          vmaheaptop(struct proc*);
+uint64          vmamap(struct proc*, uint64, int, int, struct inode*, uint, uint);
+int             vmaunmap(struct proc*, uint64, uint64);
+int             vmaadvise(struct proc*, uint64, uint64, int);
+int             vmadup(struct proc*, struct proc*);
+void            vmafree(struct proc*);
+void            vmaclear(struct vma*);
+
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
 void            virtio_disk_intr(void);
+uint64          virtio_swap_init(void);
+void            virtio_swap_rw(uint64, void*, int);
 
 
 
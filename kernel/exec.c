@@ -7,8 +7,6 @@
 #include "defs.h"
 #include "elf.h"
 
-static int loadseg(pde_t *, uint64, struct inode *, uint, uint);
-
 // map ELF permissions to PTE permission bits.
 int flags2perm(int flags)
 {
@@ -34,6 +32,10 @@ kexec(char *path, char **argv)
   struct proghdr ph;
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
+  struct vma vmas[NVMA];
+  int nvma = 0;
+
+  memset(vmas, 0, sizeof(vmas));
 
   begin_op();
 
@@ -55,7 +57,8 @@ kexec(char *path, char **argv)
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Map the program's segments. vmfault() reads
+  // each page from ip when the program first touches it.
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -67,12 +70,19 @@ kexec(char *path, char **argv)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz, flags2perm(ph.flags))) == 0)
+    if(ph.vaddr + ph.memsz >= MAXVA - (USERSTACKMAX+3)*PGSIZE)
       goto bad;
-    sz = sz1;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(nvma >= NVMA - 1)   // leave one for the stack
       goto bad;
+    vmas[nvma].start = ph.vaddr;
+    vmas[nvma].end = ph.vaddr + ph.memsz;
+    vmas[nvma].ip = idup(ip);
+    vmas[nvma].off = ph.off;
+    vmas[nvma].filesz = ph.filesz;
+    vmas[nvma].perm = PTE_R | flags2perm(ph.flags);
+    nvma++;
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
   }
   iunlockput(ip);
   end_op();
@@ -81,15 +91,24 @@ kexec(char *path, char **argv)
   p = myproc();
   uint64 oldsz = p->sz;
 
-  // Allocate some pages at the next page boundary.
-  // Make the first inaccessible as a stack guard.
-  // Use the rest as the user stack.
+  // At the next page boundary, allocate a page and make it
+  // inaccessible as a stack guard. Reserve the USERSTACKMAX
+  // pages above it for the user stack, which vmfault() fills
+  // in as the program touches them, but allocate the top
+  // USERSTACK now for the arguments: copyout() can't fault
+  // pages into a page table that isn't the process's yet
+  // (fault() panics if asked to).
   sz = PGROUNDUP(sz);
-  uint64 sz1;
-  if((sz1 = uvmalloc(pagetable, sz, sz + (USERSTACK+1)*PGSIZE, PTE_W)) == 0)
+  if(uvmalloc(pagetable, sz, sz + PGSIZE, 0) == 0)
+    goto bad;
+  uvmclear(pagetable, sz);
+  vmas[nvma].start = sz + PGSIZE;
+  sz += (USERSTACKMAX+1)*PGSIZE;
+  vmas[nvma].end = sz;
+  vmas[nvma].perm = PTE_R | PTE_W;
+  nvma++;
+  if(uvmalloc(pagetable, sz - USERSTACK*PGSIZE, sz, PTE_W) == 0)
     goto bad;
-  sz = sz1;
-  uvmclear(pagetable, sz-(USERSTACK+1)*PGSIZE);
   sp = sz;
   stackbase = sp - USERSTACK*PGSIZE;
 
@@ -128,12 +147,18 @@ kexec(char *path, char **argv)
   safestrcpy(p->name, last, sizeof(p->name));
     
   // Commit to the user image.
+  vmafree(p);
+  acquire(&p->lock);   // for uvmusage() in other processes
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
   p->sz = sz;
+  release(&p->lock);
   p->trapframe->epc = elf.entry;  // initial program counter = ulib.c:start()
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
+  memmove(p->vmas, vmas, sizeof(vmas));
+  // the old image's translations are still cached under p's ASID.
+  tlbflush(p->pagetable);
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -142,32 +167,10 @@ kexec(char *path, char **argv)
     proc_freepagetable(pagetable, sz);
   if(ip){
     iunlockput(ip);
-    end_op();
+  } else {
+    begin_op();
   }
+  vmaclear(vmas);
+  end_op();
   return -1;
 }
-
-// Load an ELF program segment into pagetable at virtual address va.
-// va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
-// Returns 0 on success, -1 on failure.
-static int
-loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
-{
-  uint i, n;
-  uint64 pa;
-
-  for(i = 0; i < sz; i += PGSIZE){
-    pa = walkaddr(pagetable, va + i);
-    if(pa == 0)
-      panic("loadseg: address should exist");
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, 0, (uint64)pa, offset+i, n) != n)
-      return -1;
-  }
-  
-  return 0;
-}
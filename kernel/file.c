@@ -106,7 +106,9 @@ filestat(struct file *f, uint64 addr)
 int
 fileread(struct file *f, uint64 addr, int n)
 {
-  int r = 0;
+  int r = 0, m, k, refused;
+  char *buf;
+  struct proc *p = myproc();
 
   if(f->readable == 0)
     return -1;
@@ -118,10 +120,46 @@ fileread(struct file *f, uint64 addr, int n)
       return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
+    // straight into user memory if it is all there. the copy
+    // mustn't fault in pages under ilock(): that can take this
+    // or another inode's lock and bread(). with p->nofault set,
+    // copyout() fails instead of faulting, leaving f->off as it
+    // was, and the read is done again through a kernel page,
+    // copied out with no locks held.
+    p->nofault = 1;
     ilock(f->ip);
     if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
       f->off += r;
     iunlock(f->ip);
+    refused = p->nofault == 2;
+    p->nofault = 0;
+    if(!refused)
+      return r;
+
+    if((buf = kalloc()) == 0)
+      return -1;
+    r = 0;
+    while(r < n){
+      m = n - r;
+      if(m > PGSIZE)
+        m = PGSIZE;
+      ilock(f->ip);
+      k = readi(f->ip, 0, (uint64)buf, f->off, m);
+      iunlock(f->ip);
+      if(k <= 0)
+        break;
+      if(copyout(p->pagetable, addr + r, buf, k) < 0){
+        if(r == 0)
+          r = -1;
+        break;
+      }
+      // only once copied, so a failed read skips nothing.
+      f->off += k;
+      r += k;
+      if(k < m)
+        break;
+    }
+    kfree(buf);
   } else {
     panic("fileread");
   }
@@ -151,25 +189,46 @@ filewrite(struct file *f, uint64 addr, int n)
     // i-node, indirect block, allocation blocks,
     // and 2 blocks of slop for non-aligned writes.
     int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
+    int i = 0, refused = 0;
+    char *buf = 0;
+    struct proc *p = myproc();
+
+    // straight from user memory while it is all there, as in
+    // fileread(); from the first page that isn't, through a
+    // kernel page filled by copyin() with no locks held.
     while(i < n){
       int n1 = n - i;
       if(n1 > max)
         n1 = max;
+      if(buf && copyin(p->pagetable, buf, addr + i, n1) < 0)
+        break;
 
       begin_op();
       ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
+      if(buf){
+        r = writei(f->ip, 0, (uint64)buf, f->off, n1);
+      } else {
+        p->nofault = 1;
+        r = writei(f->ip, 1, addr + i, f->off, n1);
+        refused = p->nofault == 2;
+        p->nofault = 0;
+      }
+      if(r > 0)
         f->off += r;
       iunlock(f->ip);
       end_op();
 
-      if(r != n1){
+      if(r < 0 || (r != n1 && !refused)){
         // error from writei
         break;
       }
       i += r;
+      if(refused && (buf = kalloc()) == 0)
+        break;
+      refused = 0;
     }
+    if(buf)
+      kfree(buf);
     ret = (i == n ? n : -1);
   } else {
     panic("filewrite");
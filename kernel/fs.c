@@ -272,6 +272,7 @@ iget(uint dev, uint inum)
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->text = 1;   // the cache may hold pages from an earlier life
   release(&itable.lock);
 
   return ip;
@@ -452,6 +453,7 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  textinval(ip);
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -536,6 +538,7 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
+  textinval(ip);
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     uint addr = bmap(ip, off/BSIZE);
     if(addr == 0)
@@ -1,12 +1,19 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. Allocates whole 4096-byte pages,
+// or physically contiguous, naturally aligned blocks of
+// 2^order pages with kalloc_order().
+//
+// Build with KALLOC_JUNK defined (make KALLOC_JUNK=1) to fill
+// pages with junk on kalloc() and kfree(), to catch dangling refs
+// and uses of uninitialized memory.
 
 #include "types.h"
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
+#include "kalloc.h"
 #include "defs.h"
 
 void freerange(void *pa_start, void *pa_end);
@@ -16,17 +23,67 @@ extern char end[]; // first address after kernel.
 
 struct run {
   struct run *next;
+  struct run *prev; // only maintained on the buddy free lists
 };
 
+// the global pool is a binary buddy allocator over
+// KERNBASE..PHYSTOP: a free block of order k is 2^k pages
+// aligned to 2^k pages, and is merged with its buddy (the
+// other half of the order k+1 block) when both are free.
+// harts only touch it in batches.
+#define NPHYSPAGES ((PHYSTOP - KERNBASE) / PGSIZE)
+#define PA2PG(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+#define PG2PA(pg) (KERNBASE + (uint64)(pg) * PGSIZE)
+
 struct {
   struct spinlock lock;
-  struct run *freelist;
+  struct run *free[KMAXORDER+1];   // free blocks of each order
+  uint64 nblocks[KMAXORDER+1];
+  // order+1 if the page heads a free block, else 0.
+  uchar head[NPHYSPAGES];
 } kmem;
 
+// each hart keeps a private cache of free pages, so that
+// most kalloc()s and kfree()s don't contend on kmem.lock.
+// an empty cache is refilled from kmem with KBATCH pages;
+// a cache that grows past KCACHEMAX gives KBATCH back.
+// if kmem is empty too, kalloc() steals half of another
+// hart's cache. the lock is only contended by stealers.
+#define KBATCHORDER 5
+#define KBATCH     (1 << KBATCHORDER)
+#define KCACHEMAX  (2*KBATCH)
+
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;
+} kcache[NCPU];
+
+// pages that idle harts have already zeroed, for
+// kalloc_zeroed(). each page is all zeroes except for
+// its run.next link.
+#define KZEROBATCHORDER 3
+#define KZEROMAX   256
+
+struct {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;
+} kzero;
+
+// extra references to single pages that kshare() has handed
+// out, e.g. to processes sharing them copy-on-write after
+// fork(). kfree() drops one; the page is only freed by a
+// kfree() that finds none left. updated with atomics.
+static uint kshares[NPHYSPAGES];
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
+  initlock(&kzero.lock, "kzero");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kcache[i].lock, "kcache");
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -39,27 +96,285 @@ freerange(void *pa_start, void *pa_end)
     kfree(p);
 }
 
+static void
+buddy_push(uint64 pg, int order)
+{
+  struct run *r = (struct run*)PG2PA(pg);
+
+  r->prev = 0;
+  r->next = kmem.free[order];
+  if(r->next)
+    r->next->prev = r;
+  kmem.free[order] = r;
+  kmem.head[pg] = order + 1;
+  kmem.nblocks[order]++;
+}
+
+static void
+buddy_remove(uint64 pg, int order)
+{
+  struct run *r = (struct run*)PG2PA(pg);
+
+  if(r->prev)
+    r->prev->next = r->next;
+  else
+    kmem.free[order] = r->next;
+  if(r->next)
+    r->next->prev = r->prev;
+  kmem.head[pg] = 0;
+  kmem.nblocks[order]--;
+}
+
+// Return a block of 2^order pages to the buddy
+// allocator, merging it with its free buddies.
+// Caller must hold kmem.lock.
+static void
+buddy_free(void *pa, int order)
+{
+  uint64 pg = PA2PG(pa);
+
+  while(order < KMAXORDER){
+    uint64 buddy = pg ^ (1L << order);
+    if(buddy >= NPHYSPAGES || kmem.head[buddy] != order + 1)
+      break;
+    buddy_remove(buddy, order);
+    pg &= buddy;
+    order++;
+  }
+  buddy_push(pg, order);
+}
+
+// Take a block of 2^order pages from the buddy allocator,
+// splitting a larger block if need be.
+// Caller must hold kmem.lock.
+// Returns 0 if there is no large enough free block.
+static void*
+buddy_alloc(int order)
+{
+  int k;
+  uint64 pg;
+
+  for(k = order; k <= KMAXORDER && kmem.free[k] == 0; k++)
+    ;
+  if(k > KMAXORDER)
+    return 0;
+  pg = PA2PG(kmem.free[k]);
+  buddy_remove(pg, k);
+  // give back the upper halves.
+  while(k > order){
+    k--;
+    buddy_push(pg + (1L << k), k);
+  }
+  return (void*)PG2PA(pg);
+}
+
+// Move up to n pages from the front of *from onto *to.
+// Returns the number of pages moved.
+static int
+kmove(struct run **from, struct run **to, int n)
+{
+  struct run *r;
+  int i;
+
+  for(i = 0; i < n && (r = *from) != 0; i++){
+    *from = r->next;
+    r->next = *to;
+    *to = r;
+  }
+  return i;
+}
+
+// Take up to 2^order single pages from the buddy
+// allocator, as one block if possible, onto *to.
+// Caller must hold kmem.lock.
+// Returns the number of pages taken.
+static int
+kmem_take(struct run **to, int order)
+{
+  char *pa;
+  int i, n = 1 << order;
+
+  if((pa = buddy_alloc(order)) == 0){
+    for(i = 0; i < n && (pa = buddy_alloc(0)) != 0; i++){
+      ((struct run*)pa)->next = *to;
+      *to = (struct run*)pa;
+    }
+    return i;
+  }
+  for(i = 0; i < n; i++, pa += PGSIZE){
+    ((struct run*)pa)->next = *to;
+    *to = (struct run*)pa;
+  }
+  return n;
+}
+
+// Refill hart id's empty cache, first from kmem,
+// then by stealing from the other harts.
+// Called with interrupts off and kcache[id].lock not held.
+static void
+krefill(int id)
+{
+  struct kcache *kc = &kcache[id];
+  struct run *batch = 0;
+  int n;
+
+  acquire(&kmem.lock);
+  n = kmem_take(&batch, KBATCHORDER);
+  release(&kmem.lock);
+
+  for(int i = 1; n == 0 && i < NCPU; i++){
+    struct kcache *victim = &kcache[(id + i) % NCPU];
+    acquire(&victim->lock);
+    n = kmove(&victim->freelist, &batch, (victim->n + 1) / 2);
+    victim->n -= n;
+    release(&victim->lock);
+  }
+
+  acquire(&kc->lock);
+  kc->n += kmove(&batch, &kc->freelist, n);
+  release(&kc->lock);
+}
+
+// Count the free buddy blocks into mi.
+// Caller must hold kmem.lock.
+static void
+kmem_count(struct kmeminfo *mi)
+{
+  for(int k = 0; k <= KMAXORDER; k++){
+    mi->nblocks[k] = kmem.nblocks[k];
+    mi->nfree += kmem.nblocks[k] << k;
+  }
+}
+
+// Give every page cached by the harts and the pre-zeroed
+// pool back to the buddy allocator, so they can merge.
+// Used when a multi-page allocation fails. If mi isn't 0,
+// count the blocks into it before anyone can take any.
+static void
+kdrain(struct kmeminfo *mi)
+{
+  struct run *r, *batch = 0;
+
+  for(int i = 0; i < NCPU; i++){
+    acquire(&kcache[i].lock);
+    kmove(&kcache[i].freelist, &batch, kcache[i].n);
+    kcache[i].n = 0;
+    release(&kcache[i].lock);
+  }
+  acquire(&kzero.lock);
+  kmove(&kzero.freelist, &batch, kzero.n);
+  kzero.n = 0;
+  release(&kzero.lock);
+
+  acquire(&kmem.lock);
+  while((r = batch) != 0){
+    batch = r->next;
+    buddy_free(r, 0);
+  }
+  if(mi)
+    kmem_count(mi);
+  release(&kmem.lock);
+}
+
+// Pop a page off the pre-zeroed pool, clearing its
+// link so the whole page is zero. Returns 0 if empty.
+static struct run*
+kzero_take(void)
+{
+  struct run *r;
+
+  acquire(&kzero.lock);
+  r = kzero.freelist;
+  if(r){
+    kzero.freelist = r->next;
+    kzero.n--;
+  }
+  release(&kzero.lock);
+
+  if(r)
+    r->next = 0;
+  return r;
+}
+
+// Take another reference to the page at pa, which
+// must have come from kalloc(). Each reference is
+// given up with kfree().
+void
+kshare(void *pa)
+{
+  __atomic_fetch_add(&kshares[PA2PG(pa)], 1, __ATOMIC_RELAXED);
+}
+
+// Number of references to the page at pa.
+int
+krefs(void *pa)
+{
+  return 1 + __atomic_load_n(&kshares[PA2PG(pa)], __ATOMIC_ACQUIRE);
+}
+
+// Drop one of several references to the page at pa.
+// Returns 0 if pa had only the caller's reference,
+// which kfree() then frees.
+static int
+kunshare(void *pa)
+{
+  uint *s = &kshares[PA2PG(pa)];
+  uint n = __atomic_load_n(s, __ATOMIC_ACQUIRE);
+
+  while(n > 0){
+    if(__atomic_compare_exchange_n(s, &n, n - 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      return 1;
+  }
+  return 0;
+}
+
 // Free the page of physical memory pointed at by pa,
 // which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// If the page is shared (see kshare()), only
+// drops the caller's reference.
 void
 kfree(void *pa)
 {
-  struct run *r;
+  struct run *r, *batch = 0;
+  struct kcache *kc;
+  int n = 0;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  if(kunshare(pa))
+    return;
+
+#ifdef KALLOC_JUNK
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
+#endif
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  kc = &kcache[cpuid()];
+  acquire(&kc->lock);
+  r->next = kc->freelist;
+  kc->freelist = r;
+  kc->n++;
+  if(kc->n > KCACHEMAX){
+    n = kmove(&kc->freelist, &batch, KBATCH);
+    kc->n -= n;
+  }
+  release(&kc->lock);
+  pop_off();
+
+  if(n){
+    acquire(&kmem.lock);
+    while((r = batch) != 0){
+      batch = r->next;
+      buddy_free(r, 0);
+    }
+    release(&kmem.lock);
+  }
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -69,14 +384,176 @@ void *
 kalloc(void)
 {
   struct run *r;
+  struct kcache *kc;
+  int id;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  push_off();
+  id = cpuid();
+  kc = &kcache[id];
+  if(kc->freelist == 0)
+    krefill(id);
+  acquire(&kc->lock);
+  r = kc->freelist;
+  if(r){
+    kc->freelist = r->next;
+    kc->n--;
+  }
+  release(&kc->lock);
+  pop_off();
 
+  if(r == 0)
+    r = kzero_take(); // last resort: the pre-zeroed pool
+  if(r == 0){
+    // textreclaim() frees slab objects too, so goes first,
+    // and swapping user pages out is slowest, so goes last.
+    int n = textreclaim();
+    if(n + slab_reclaim() > 0 || swapreclaim(0) > 0)
+      return kalloc();
+  }
+
+#ifdef KALLOC_JUNK
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
+#endif
   return (void*)r;
 }
+
+// Allocate 2^order physically contiguous pages, aligned
+// to their size. Order 0 is the same as kalloc().
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc_order(int order)
+{
+  void *pa;
+
+  if(order == 0)
+    return kalloc();
+  if(order < 0 || order > KMAXORDER)
+    return 0;
+
+  acquire(&kmem.lock);
+  pa = buddy_alloc(order);
+  release(&kmem.lock);
+
+  if(pa == 0){
+    // cached single pages may be what keeps blocks from merging.
+    slab_reclaim();
+    kdrain(0);
+    acquire(&kmem.lock);
+    pa = buddy_alloc(order);
+    release(&kmem.lock);
+  }
+
+#ifdef KALLOC_JUNK
+  if(pa)
+    memset(pa, 5, PGSIZE << order);
+#endif
+  return pa;
+}
+
+// Free 2^order pages returned by kalloc_order(order).
+void
+kfree_order(void *pa, int order)
+{
+  if(order == 0){
+    kfree(pa);
+    return;
+  }
+  if(order < 0 || order > KMAXORDER ||
+     ((uint64)pa % (PGSIZE << order)) != 0 ||
+     (char*)pa < end || (uint64)pa + (PGSIZE << order) > PHYSTOP)
+    panic("kfree_order");
+
+#ifdef KALLOC_JUNK
+  memset(pa, 1, PGSIZE << order);
+#endif
+
+  acquire(&kmem.lock);
+  buddy_free(pa, order);
+  release(&kmem.lock);
+}
+
+// Allocate one zero-filled page, preferably one that
+// an idle hart has already cleared.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc_zeroed(void)
+{
+  struct run *r;
+
+  if((r = kzero_take()) != 0)
+    return (void*)r;
+  if((r = kalloc()) != 0)
+    memset((char*)r, 0, PGSIZE);
+  return (void*)r;
+}
+
+// Called by scheduler() on an idle hart: zero a batch of
+// pages from kmem and add them to the pre-zeroed pool.
+// Returns the number of pages zeroed, 0 if there was
+// nothing to do.
+int
+kzero_fill(void)
+{
+  struct run *r, *batch = 0, *zeroed = 0;
+  int n;
+
+  if(kzero.n >= KZEROMAX)
+    return 0;
+
+  // only take pages nobody else is caching.
+  acquire(&kmem.lock);
+  n = kmem_take(&batch, KZEROBATCHORDER);
+  release(&kmem.lock);
+
+  while((r = batch) != 0){
+    batch = r->next;
+    memset((char*)r, 0, PGSIZE);
+    r->next = zeroed;
+    zeroed = r;
+  }
+
+  if(n){
+    acquire(&kzero.lock);
+    kzero.n += kmove(&zeroed, &kzero.freelist, n);
+    release(&kzero.lock);
+  }
+  return n;
+}
+
+// the caches' share of the free pages.
+static void
+kcache_count(struct kmeminfo *mi)
+{
+  // a racy snapshot of the caches is good enough.
+  for(int i = 0; i < NCPU; i++)
+    mi->ncached += kcache[i].n;
+  mi->ncached += kzero.n;
+  mi->nfree += mi->ncached;
+  mi->ncpu = ncpus();
+  mi->ntext = textpages();
+}
+
+// Report free memory, for the kmeminfo() system call.
+void
+kmeminfo(struct kmeminfo *mi)
+{
+  memset(mi, 0, sizeof(*mi));
+  acquire(&kmem.lock);
+  kmem_count(mi);
+  release(&kmem.lock);
+  kcache_count(mi);
+}
+
+// Give the pages held in the caches and in empty slabs
+// back to the buddy allocator first, then report as
+// kmeminfo() does, so that fragmentation can be measured
+// without the caches' noise. For the kmemdrain() system call.
+void
+kmemdrain(struct kmeminfo *mi)
+{
+  memset(mi, 0, sizeof(*mi));
+  slab_reclaim();
+  kdrain(mi);
+  kcache_count(mi);
+}
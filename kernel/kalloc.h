@@ -0,0 +1,43 @@
+#define KMAXORDER 10  // largest kalloc_order() block: 2^10 pages
+
+// free physical memory and transparent huge page
+// counters, as reported by kmeminfo().
+struct kmeminfo {
+  uint64 nfree;                   // free pages in total
+  uint64 ncached;                 // of those, held in per-hart and pre-zeroed caches
+  uint64 ncpu;                    // harts running, each with a cache of its own
+  uint64 nblocks[KMAXORDER+1];    // free buddy blocks of each order
+  uint64 ntext;                   // pages in the shared program text cache
+  uint64 nthpfault;               // user heap faults served with a 2 MiB page
+  uint64 nthpfallback;            // ... that fell back to 4 KiB for lack of memory
+  uint64 nthpsplit;               // 2 MiB pages split into 4 KiB pages
+  uint64 nzerofault;              // heap read faults served with the shared zero page
+  uint64 nswapslots;              // page slots on the swap disk; 0 if none
+  uint64 nswapused;               // of those, holding swapped-out pages
+  uint64 nswapout;                // pages ever swapped out
+  uint64 nswapin;                 // pages ever swapped back in
+  uint64 swapintime;              // time those took, in r_time() units (10 MHz on qemu)
+  uint64 nzram;                   // pages held compressed in memory
+  uint64 nzramzero;               // of those, all zeros, which take no space
+  uint64 nzrambytes;              // compressed bytes held
+  uint64 nzrammem;                // kmalloc() memory they take up
+  uint64 nzramout;                // pages ever compressed
+  uint64 nzramin;                 // pages ever decompressed on a fault
+  uint64 zramintime;              // time those took, in r_time() units
+  uint64 nzramreject;             // pages that didn't compress well enough
+  uint64 nksmpages;               // pages shared by same-page merging
+  uint64 nksmsaved;               // pages that merging has freed
+  uint64 nksmmerged;              // pages ever merged
+  uint64 noomkill;                // processes killed for lack of memory
+};
+
+// usage of one slab cache, as reported by slabinfo().
+struct slabinfo {
+  char name[16];
+  uint objsize;                   // bytes per object
+  uint perslab;                   // objects per slab page
+  uint64 nslabs;                  // pages held by the cache
+  uint64 inuse;                   // objects allocated and not yet freed
+  uint64 ncached;                 // free objects in per-hart magazines
+  uint64 nalloc;                  // allocations ever made
+};
@@ -0,0 +1,245 @@
+// Kernel same-page merging, in kernels built with make KSM=1.
+//
+// Harts with nothing to run call ksmscan(), which moves a cursor
+// over the heap pages of processes that aren't running, KSMBATCH
+// pages per clock tick. A page written since the cursor last
+// passed (PTE_D set) is too busy to be worth merging, and is
+// only marked clean. A clean private page is hashed, and:
+//
+//  - if the stable table holds a merged page with the same hash
+//    and contents, the page is replaced by that one;
+//  - otherwise, if the unstable table remembers a page of the
+//    same hash and contents seen earlier, the two are merged
+//    into that one, which goes in the stable table;
+//  - otherwise it is remembered in the unstable table.
+//
+// Merged pages are mapped read-only and copy-on-write, so the
+// first write to one gives the writer back a page of its own
+// (see uvmcow() in vm.c). The stable table holds a reference
+// to each of its pages, and lets go of those no one else maps.
+//
+// Like swapreclaim(), ksmscan() only changes the page tables of
+// processes whose lock it holds and that can't be in the middle
+// of changing them themselves (see swappable()); holding the
+// lock also keeps a process's pages from changing under it.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "kalloc.h"
+#include "defs.h"
+
+#define KSMBATCH    256   // PTEs looked at per tick
+#define NSTABLE     512   // stable table entries
+#define NUNSTABLE   1024  // unstable table entries
+
+struct stable {
+  uint64 hash;
+  uint64 pa;      // a merged page, or 0
+};
+
+struct unstable {
+  uint64 hash;
+  int pid;        // the page at va in process pid; 0 if unused
+  uint64 va;
+};
+
+static struct {
+  struct spinlock lock;
+  struct stable stable[NSTABLE];
+  struct unstable unstable[NUNSTABLE];
+  uint tick;             // when ksmscan() last ran
+  int pid;               // the cursor: the process
+  uint64 va;             // and the address it's at
+  uint64 nmerged;        // pages merged
+} ksm;
+
+void
+ksminit(void)
+{
+  initlock(&ksm.lock, "ksm");
+}
+
+static uint64
+pagehash(uint64 *pa)
+{
+  uint64 h = 0;
+
+  for(int i = 0; i < PGSIZE / sizeof(uint64); i++)
+    h = (h ^ pa[i]) * 0x9e3779b97f4a7c15UL;
+  return h ^ (h >> 32);
+}
+
+// The PTE of p's page at va if it's a private 4 KiB
+// heap page that could be merged, or 0.
+static pte_t*
+candidate(struct proc *p, uint64 va)
+{
+  pte_t *pte;
+
+  if(va >= p->sz || (pte = walk(p->pagetable, va, 0)) == 0)
+    return 0;
+  if((*pte & (PTE_V|PTE_U|PTE_HUGE)) != (PTE_V|PTE_U))
+    return 0;
+  if(krefs((void*)PTE2PA(*pte)) != 1)
+    return 0;
+  return pte;
+}
+
+// Point p's PTE at the page pa, read-only, and write
+// it copy-on-write if it was writable.
+static void
+remap(struct proc *p, pte_t *pte, uint64 pa)
+{
+  uint64 old = PTE2PA(*pte);
+  uint flags = PTE_FLAGS(*pte);
+
+  if(flags & PTE_W)
+    flags = (flags & ~PTE_W) | PTE_COW;
+  if(old != pa){
+    kshare((void*)pa);
+    *pte = PA2PTE(pa) | flags;
+    kfree((void*)old);
+    ksm.nmerged++;
+  } else {
+    *pte = PA2PTE(pa) | flags;
+  }
+  // keep stale TLB entries from allowing writes.
+  p->asidgen = 0;
+}
+
+// Look for a page to merge with p's page at va.
+// Caller holds p->lock and ksm.lock.
+static void
+ksmpage(struct proc *p, uint64 va, pte_t *pte)
+{
+  uint64 pa = PTE2PA(*pte), h = pagehash((uint64*)pa);
+  struct stable *s = &ksm.stable[h % NSTABLE];
+  struct unstable *u = &ksm.unstable[h % NUNSTABLE];
+  struct proc *q;
+  pte_t *qpte;
+  uint64 qpa;
+
+  if(s->pa && krefs((void*)s->pa) == 1){
+    // no one maps it any more.
+    kfree((void*)s->pa);
+    s->pa = 0;
+  }
+  if(s->pa && s->hash == h && memcmp((void*)s->pa, (void*)pa, PGSIZE) == 0){
+    remap(p, pte, s->pa);
+    return;
+  }
+
+  if(u->pid && u->hash == h && (u->pid != p->pid || u->va != va)){
+    q = u->pid == p->pid ? p : findproc(u->pid, 1);
+    if(q && (q == p || swappable(q, 0)) && (qpte = candidate(q, u->va)) != 0 &&
+       memcmp((void*)PTE2PA(*qpte), (void*)pa, PGSIZE) == 0){
+      // q's page becomes the stable copy.
+      qpa = PTE2PA(*qpte);
+      if(s->pa)
+        kfree((void*)s->pa);
+      kshare((void*)qpa);
+      s->pa = qpa;
+      s->hash = h;
+      remap(q, qpte, qpa);
+      remap(p, pte, qpa);
+      u->pid = 0;
+      if(q != p)
+        release(&q->lock);
+      return;
+    }
+    if(q && q != p)
+      release(&q->lock);
+  }
+  u->hash = h;
+  u->pid = p->pid;
+  u->va = va;
+}
+
+// Scan the next KSMBATCH pages, if that hasn't been done
+// yet this tick. Called by the scheduler when it has
+// nothing to run. Returns 1 if it did, 0 if not.
+int
+ksmscan(void)
+{
+  struct proc *p;
+  pte_t *pte;
+  int budget = KSMBATCH;
+
+  if(!tryacquire(&ksm.lock))
+    return 0;
+  if(ksm.tick == ticks){
+    release(&ksm.lock);
+    return 0;
+  }
+  ksm.tick = ticks;
+
+  // holding a spinlock also keeps the proc chunks
+  // from going away under procnext().
+  for(p = procfirst(); p; p = procnext(p))
+    if(p->pid == ksm.pid && p->state != UNUSED)
+      break;
+  if(p == 0){
+    p = procfirst();
+    ksm.va = 0;
+  }
+  while(p && budget > 0){
+    if(tryacquire(&p->lock)){
+      if(swappable(p, 0)){
+        for(; ksm.va < p->sz && budget > 0; ksm.va += PGSIZE, budget--){
+          if((pte = candidate(p, ksm.va)) == 0)
+            continue;
+          if(*pte & PTE_D){
+            // written lately; see if it settles down.
+            *pte &= ~PTE_D;
+            p->asidgen = 0;
+            continue;
+          }
+          ksmpage(p, ksm.va, pte);
+        }
+      }
+      release(&p->lock);
+      if(budget == 0)
+        break;
+    }
+    p = procnext(p);
+    ksm.va = 0;
+  }
+  if(p == 0){
+    // end of a pass: let go of merged pages no one maps any more.
+    for(int i = 0; i < NSTABLE; i++){
+      if(ksm.stable[i].pa && krefs((void*)ksm.stable[i].pa) == 1){
+        kfree((void*)ksm.stable[i].pa);
+        ksm.stable[i].pa = 0;
+      }
+    }
+  }
+  ksm.pid = p ? p->pid : 0;
+  release(&ksm.lock);
+  return 1;
+}
+
+// Merged page usage, for kmeminfo().
+void
+ksminfo(struct kmeminfo *mi)
+{
+  uint64 n;
+
+  acquire(&ksm.lock);
+  mi->nksmpages = 0;
+  mi->nksmsaved = 0;
+  for(int i = 0; i < NSTABLE; i++){
+    if(ksm.stable[i].pa == 0)
+      continue;
+    // the table's own reference, and one per mapping.
+    n = krefs((void*)ksm.stable[i].pa) - 1;
+    mi->nksmpages++;
+    if(n > 1)
+      mi->nksmsaved += n - 1;
+  }
+  mi->nksmmerged = ksm.nmerged;
+  release(&ksm.lock);
+}
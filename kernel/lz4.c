@@ -0,0 +1,167 @@
+// LZ4 block compression, for zram.c.
+//
+// Output is in the LZ4 block format: a series of sequences, each
+// a token byte (literal length in the high four bits, match
+// length minus MINMATCH in the low four, 15 meaning more bytes
+// follow), the literals, and a two-byte little-endian offset back
+// to the match. The last sequence has literals only. The
+// compressor is the simple greedy one, with a table of the last
+// position seen for each hash of four bytes, which is quick and
+// does well on the zero-filled and repetitive pages zram sees.
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define MINMATCH     4
+#define HASHBITS     12    // the caller's table has 1 << HASHBITS entries
+#define LASTLITERALS 5     // the format ends with at least this many literals
+#define MFLIMIT      12    // and no match starts closer than this to the end
+
+static uint
+read32(const uchar *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint)p[3] << 24);
+}
+
+static uint
+hash4(uint v)
+{
+  return (v * 2654435761U) >> (32 - HASHBITS);
+}
+
+// append a length's extra bytes, after the 15 in its token.
+static uchar*
+putlen(uchar *op, uint n)
+{
+  for(; n >= 255; n -= 255)
+    *op++ = 255;
+  *op++ = n;
+  return op;
+}
+
+// append a sequence of nlit literals from lit, then a match of
+// mlen bytes off back, or no match if mlen is 0.
+// returns the new end of the output, or 0 if it would pass oend.
+static uchar*
+putseq(uchar *op, uchar *oend, const uchar *lit, uint nlit, uint off, uint mlen)
+{
+  uchar *token = op;
+
+  // token, literal lengths, literals, offset, match lengths.
+  if(oend - op < 1 + nlit/255 + 1 + nlit + 2 + mlen/255 + 1)
+    return 0;
+  op++;
+  *token = (nlit < 15 ? nlit : 15) << 4;
+  if(nlit >= 15)
+    op = putlen(op, nlit - 15);
+  memmove(op, lit, nlit);
+  op += nlit;
+  if(mlen == 0)
+    return op;
+  *op++ = off;
+  *op++ = off >> 8;
+  mlen -= MINMATCH;
+  *token |= mlen < 15 ? mlen : 15;
+  if(mlen >= 15)
+    op = putlen(op, mlen - 15);
+  return op;
+}
+
+// compress the n bytes at src (n < 64 KiB) into dst, using the
+// 1 << HASHBITS (4096) entries of tab as scratch.
+// returns the compressed length, or -1 if it's more than cap.
+int
+lz4_compress(const uchar *src, int n, uchar *dst, int cap, ushort *tab)
+{
+  const uchar *ip = src, *anchor = src, *ref, *m, *r;
+  const uchar *mflimit = src + n - MFLIMIT;
+  const uchar *matchlimit = src + n - LASTLITERALS;
+  uchar *op = dst, *oend = dst + cap;
+  uint h;
+
+  memset(tab, 0, (1 << HASHBITS) * sizeof(ushort));
+  if(n >= MFLIMIT)
+    ip++;   // the table starts out pointing at src
+  while(ip < mflimit){
+    h = hash4(read32(ip));
+    ref = src + tab[h];
+    tab[h] = ip - src;
+    if(read32(ref) != read32(ip)){
+      ip++;
+      continue;
+    }
+    m = ip + MINMATCH;
+    r = ref + MINMATCH;
+    while(m < matchlimit && *m == *r){
+      m++;
+      r++;
+    }
+    if((op = putseq(op, oend, anchor, ip - anchor, ip - ref, m - ip)) == 0)
+      return -1;
+    ip = anchor = m;
+  }
+  if((op = putseq(op, oend, anchor, src + n - anchor, 0, 0)) == 0)
+    return -1;
+  return op - dst;
+}
+
+// decompress the n bytes at src into dst.
+// returns the decompressed length, or -1 if the input
+// is malformed or would decompress to more than cap.
+int
+lz4_decompress(const uchar *src, int n, uchar *dst, int cap)
+{
+  const uchar *ip = src, *iend = src + n, *m;
+  uchar *op = dst, *oend = dst + cap;
+  uint token, len, off, b;
+
+  while(ip < iend){
+    token = *ip++;
+    len = token >> 4;
+    if(len == 15){
+      do {
+        if(ip >= iend)
+          return -1;
+        b = *ip++;
+        len += b;
+      } while(b == 255);
+    }
+    if(len > iend - ip || len > oend - op)
+      return -1;
+    memmove(op, ip, len);
+    op += len;
+    ip += len;
+    if(ip == iend)
+      break;   // the last sequence has no match
+
+    if(iend - ip < 2)
+      return -1;
+    off = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if(off == 0 || off > op - dst)
+      return -1;
+    len = token & 15;
+    if(len == 15){
+      do {
+        if(ip >= iend)
+          return -1;
+        b = *ip++;
+        len += b;
+      } while(b == 255);
+    }
+    len += MINMATCH;
+    if(len > oend - op)
+      return -1;
+    m = op - off;
+    if(off >= len){
+      memmove(op, m, len);
+      op += len;
+    } else {
+      // the match overlaps what it's copied to, e.g. a run.
+      while(len-- > 0)
+        *op++ = *m++;
+    }
+  }
+  return op - dst;
+}
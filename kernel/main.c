@@ -17,8 +17,11 @@ main()
     printf("xv6 kernel is booting\n");
     printf("\n");
     kinit();         // physical page allocator
+    slabinit();      // kernel object caches
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
+    asidinit();      // address-space identifiers
+    rvvinit();       // vector memmove() etc., if there's a vector unit
     procinit();      // process table
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
@@ -27,7 +30,12 @@ main()
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    pipeinit();      // pipe cache
+    textinit();      // shared program text cache
     virtio_disk_init(); // emulated hard disk
+    swapinit();      // swap disk, if there is one
+    ksminit();       // same-page merging
+    oominit();       // out-of-memory killer
     userinit();      // first user process
     __sync_synchronize();
     started = 1;
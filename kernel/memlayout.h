@@ -8,6 +8,7 @@
 // 0C000000 -- PLIC
 // 10000000 -- uart0 
 // 10001000 -- virtio disk 
+// 10002000 -- virtio disk for swap, if any
 // 80000000 -- qemu's boot ROM loads the kernel here,
 //             then jumps here.
 // unused RAM after 80000000.
@@ -24,6 +25,7 @@
 // virtio mmio interface
 #define VIRTIO0 0x10001000
 #define VIRTIO0_IRQ 1
+#define VIRTIO1 0x10002000  // swap disk; polled, so no IRQ
 
 // qemu puts platform-level interrupt controller (PLIC) here.
 #define PLIC 0x0c000000L
@@ -43,9 +45,9 @@
 // in both user and kernel space.
 #define TRAMPOLINE (MAXVA - PGSIZE)
 
-// map kernel stacks beneath the trampoline,
-// each surrounded by invalid guard pages.
-#define KSTACK(p) (TRAMPOLINE - ((p)+1)* 2*PGSIZE)
+// kernel stacks are mapped beneath the trampoline, in NKSTACK
+// slots, each above an invalid guard page. see kstackalloc().
+#define KSTACK(i) (TRAMPOLINE - ((i)+1)* 2*PGSIZE)
 
 // User memory layout.
 // Address zero first:
@@ -54,6 +56,9 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   mmap() regions, growing down from MMAPTOP
+//   guard page
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define MMAPTOP (TRAPFRAME - PGSIZE)
@@ -0,0 +1,12 @@
+// mmap() protection and flags.
+#define PROT_READ     0x1
+#define PROT_WRITE    0x2
+#define PROT_EXEC     0x4
+
+#define MAP_SHARED    0x01  // writes go back to the file
+#define MAP_PRIVATE   0x02  // writes are private to the process
+#define MAP_ANONYMOUS 0x20  // zero-filled; no file
+
+// madvise() advice.
+#define MADV_WILLNEED 3     // fault the pages in now
+#define MADV_DONTNEED 4     // free the pages; touching them faults them in again
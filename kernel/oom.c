@@ -0,0 +1,116 @@
+// The out-of-memory killer.
+//
+// When vmfault() can't get a page for a process even after
+// swapping others out, it calls oomkill(), which kills the
+// process holding the most memory instead of failing the one
+// that happened to fault. A process's badness is the pages it
+// has mapped, swapped out and in page tables (see uvmusage()).
+// init is never picked.
+//
+// The faulting process then waits in oomwait() for the victim
+// to exit, which gives back its user memory at once (see
+// kexit()), and tries the fault again. While a victim is still
+// on its way out, oomkill() doesn't kill another.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "kalloc.h"
+#include "defs.h"
+
+static struct {
+  struct spinlock lock;
+  uint64 nkill;           // processes killed
+} oom;
+
+void
+oominit(void)
+{
+  initlock(&oom.lock, "oom");
+}
+
+// Memory held by p, in pages. Caller holds p->lock.
+static uint64
+badness(struct proc *p)
+{
+  uint64 rss = 0, nswapped = 0, npt = 0;
+
+  if(p->pagetable == 0)
+    return 0;
+  uvmusage(p->pagetable, &rss, &nswapped, &npt);
+  return rss + nswapped + npt;
+}
+
+// self is out of memory: kill the process holding the most,
+// unless an earlier victim is still exiting. Sets self->oomwait
+// if self should wait for memory and try again.
+void
+oomkill(struct proc *self)
+{
+  struct proc *p;
+  uint64 n, best = 0;
+  int pid = 0, dying = 0;
+  char name[16];
+
+  // holding a spinlock also keeps the proc chunks
+  // from going away under procnext().
+  acquire(&oom.lock);
+  for(p = procfirst(); p; p = procnext(p)){
+    if(!tryacquire(&p->lock))
+      continue;
+    if(p->pid > 1 && p->state != UNUSED && p->state != ZOMBIE &&
+       (n = badness(p)) > 0){
+      if(p->killed)
+        dying = 1;
+      else if(n > best){
+        best = n;
+        pid = p->pid;
+      }
+    }
+    release(&p->lock);
+  }
+  if(!dying && pid && (p = findproc(pid, 1)) != 0){
+    p->killed = 1;
+    if(p->state == SLEEPING)
+      p->state = RUNNABLE;
+    safestrcpy(name, p->name, sizeof(name));
+    release(&p->lock);
+    oom.nkill++;
+    printf("oom: killed pid %d (%s), %lu pages\n", pid, name, best);
+  } else if(!dying && pid == 0){
+    release(&oom.lock);
+    return;   // no one to kill
+  }
+  release(&oom.lock);
+  self->oomwait = 1;
+}
+
+// Called by usertrap() when p's page fault failed. If that
+// was for lack of memory, and oomkill() has killed a process
+// to make room, wait a tick for it to exit and return 1, so
+// that the fault is tried again. Returns 0 otherwise.
+int
+oomwait(struct proc *p)
+{
+  if(!p->oomwait)
+    return 0;
+  p->oomwait = 0;
+  if(killed(p))
+    return 1;   // p was the victim
+  acquire(&tickslock);
+  sleep(&ticks, &tickslock);
+  release(&tickslock);
+  return 1;
+}
+
+// Out-of-memory kills, for kmeminfo().
+void
+oominfo(struct kmeminfo *mi)
+{
+  acquire(&oom.lock);
+  mi->noomkill = oom.nkill;
+  release(&oom.lock);
+}
@@ -1,6 +1,7 @@
-#define NPROC        64  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
+#define NKSTACK   32768  // kernel stack slots, so most processes at once
+#define NVMA         16  // mapped memory regions per process
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
@@ -11,5 +12,8 @@
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
-#define USERSTACK    1     // user stack pages
+#define USERSTACK    1     // user stack pages exec() fills in
+#define USERSTACKMAX 256   // user stack pages at most; used ones are allocated on demand
+#define TIMEBASE  10000000 // r_time() counts per second (qemu's 10 MHz)
+#define TICKHZ       10    // timer interrupts, so uptime() ticks, per second
 
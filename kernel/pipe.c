@@ -10,6 +10,11 @@
 
 #define PIPESIZE 512
 
+// copyin() and copyout() may fault a page in, and sleep,
+// so they can't run under pi->lock. bytes go through a
+// buffer of this size on the kernel stack instead.
+#define PIPEBOUNCE 256
+
 struct pipe {
   struct spinlock lock;
   char data[PIPESIZE];
@@ -19,6 +24,14 @@ struct pipe {
   int writeopen;  // write fd is still open
 };
 
+static struct kmem_cache *pipecache;
+
+void
+pipeinit(void)
+{
+  pipecache = kmem_cache_create("pipe", sizeof(struct pipe));
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,7 +41,7 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((pi = (struct pipe*)kalloc()) == 0)
+  if((pi = (struct pipe*)kmem_cache_alloc(pipecache)) == 0)
     goto bad;
   pi->readopen = 1;
   pi->writeopen = 1;
@@ -47,7 +60,7 @@ pipealloc(struct file **f0, struct file **f1)
 
  bad:
   if(pi)
-    kfree((char*)pi);
+    kmem_cache_free(pipecache, pi);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -68,7 +81,7 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    kmem_cache_free(pipecache, pi);
   } else
     release(&pi->lock);
 }
@@ -76,38 +89,55 @@ pipeclose(struct pipe *pi, int writable)
 int
 pipewrite(struct pipe *pi, uint64 addr, int n)
 {
-  int i = 0;
+  int i = 0, j, m, k;
+  char buf[PIPEBOUNCE];
   struct proc *pr = myproc();
 
-  acquire(&pi->lock);
   while(i < n){
-    if(pi->readopen == 0 || killed(pr)){
-      release(&pi->lock);
-      return -1;
-    }
-    if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
-      wakeup(&pi->nread);
-      sleep(&pi->nwrite, &pi->lock);
-    } else {
-      char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-        break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+    m = n - i;
+    if(m > PIPEBOUNCE)
+      m = PIPEBOUNCE;
+    if(copyin(pr->pagetable, buf, addr + i, m) == -1)
+      break;
+    acquire(&pi->lock);
+    for(j = 0; j < m; ){
+      if(pi->readopen == 0 || killed(pr)){
+        release(&pi->lock);
+        return -1;
+      }
+      if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
+        wakeup(&pi->nread);
+        sleep(&pi->nwrite, &pi->lock);
+      } else {
+        // as much as fits before the buffer wraps or fills.
+        uint off = pi->nwrite % PIPESIZE;
+        k = PIPESIZE - off;
+        if(k > pi->nread + PIPESIZE - pi->nwrite)
+          k = pi->nread + PIPESIZE - pi->nwrite;
+        if(k > m - j)
+          k = m - j;
+        memmove(&pi->data[off], buf + j, k);
+        pi->nwrite += k;
+        j += k;
+      }
     }
+    wakeup(&pi->nread);
+    release(&pi->lock);
+    i += m;
   }
-  wakeup(&pi->nread);
-  release(&pi->lock);
 
   return i;
 }
 
+// Bytes taken from the pipe are gone even if copyout()
+// then fails; the read returns what was copied, or -1.
 int
 piperead(struct pipe *pi, uint64 addr, int n)
 {
-  int i;
+  int i, m, tot = 0;
+  uint off;
+  char buf[PIPEBOUNCE];
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
@@ -117,18 +147,29 @@ piperead(struct pipe *pi, uint64 addr, int n)
     }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1) {
-      if(i == 0)
-        i = -1;
-      break;
+  while(tot < n && pi->nread != pi->nwrite){
+    for(i = 0; i < n - tot && i < PIPEBOUNCE; i += m){  //DOC: piperead-copy
+      if(pi->nread == pi->nwrite)
+        break;
+      // as much as is there before the buffer wraps.
+      off = pi->nread % PIPESIZE;
+      m = PIPESIZE - off;
+      if(m > pi->nwrite - pi->nread)
+        m = pi->nwrite - pi->nread;
+      if(m > n - tot - i)
+        m = n - tot - i;
+      if(m > PIPEBOUNCE - i)
+        m = PIPEBOUNCE - i;
+      memmove(buf + i, &pi->data[off], m);
+      pi->nread += m;
     }
-    pi->nread++;
+    wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+    release(&pi->lock);
+    if(copyout(pr->pagetable, addr + tot, buf, i) == -1)
+      return tot > 0 ? tot : -1;
+    tot += i;
+    acquire(&pi->lock);
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
   release(&pi->lock);
-  return i;
+  return tot;
 }
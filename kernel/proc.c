@@ -8,7 +8,35 @@
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+// struct procs are carved out of whole pages ("chunks") on
+// demand, so the number of processes is limited by memory, and
+// by the NKSTACK slots kernel stacks are mapped in (kstackalloc()).
+// scheduler(), wakeup() and friends walk the chunk list without
+// a lock, so chunk memory must stay valid while they look at it:
+// a chunk whose procs are all free is first unlinked, and only
+// handed back to kalloc() once every CPU has passed through the
+// top of the scheduler loop (see proc_reclaim()).
+struct procchunk {
+  struct procchunk *next;      // all live chunks, walked lock-free
+  struct procchunk *limbonext; // retired chunks awaiting reclaim
+  int nfree;                   // procs of this chunk on the free list
+  uint64 qs[NCPU];             // cpus[i].qs when retired
+  struct proc procs[];
+};
+
+#define NPROCCHUNK ((PGSIZE - sizeof(struct procchunk)) / sizeof(struct proc))
+#define PROCCHUNK(p) ((struct procchunk *)PGROUNDDOWN((uint64)(p)))
+
+#define NPIDHASH 64
+#define PIDHASH(pid) ((pid) % NPIDHASH)
+
+struct {
+  struct spinlock lock;
+  struct procchunk *chunks;
+  struct procchunk *limbo;
+  struct proc *freelist;             // UNUSED procs, linked by freenext
+  struct proc *pidhash[NPIDHASH];    // allocated procs, linked by pidnext
+} ptable;
 
 struct proc *initproc;
 
@@ -17,14 +45,17 @@ struct spinlock pid_lock;
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void procfree(struct proc *p);
+static void child_insert(struct proc **head, struct proc *c);
+static void child_remove(struct proc **head, struct proc *c);
 
 extern char trampoline[]; // trampoline.S
 
-// helps ensure that wakeups of wait()ing
-// parents are not lost. helps obey the
-// memory model when using p->parent.
-// must be acquired before any p->lock.
-struct spinlock wait_lock;
+// each process's childlock protects its children and
+// zombies lists and the parent/sib* fields of the procs
+// on them. it ensures that wakeups of wait()ing parents
+// are not lost. lock order: a process's own childlock,
+// then initproc->childlock, then any p->lock.
 
 // ============= NEW MLFQ HELPER FUNCTIONS - NEW CODE =============
 
@@ -64,7 +95,7 @@ boost_all_priorities(void)
 {
   struct proc *p;
   
-  for(p = proc; p < &proc[NPROC]; p++) {
+  for(p = procfirst(); p; p = procnext(p)) {
     // Don't acquire locks in interrupt context!
     // Just do the assignment - it's atomic
     if(p->state == RUNNABLE || p->state == RUNNING) {
@@ -76,36 +107,193 @@ boost_all_priorities(void)
 }
 // ============= END OF NEW MLFQ HELPER FUNCTIONS =============
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
+// initialize the proc table.
 void
-proc_mapstacks(pagetable_t kpgtbl)
+procinit(void)
+{
+  initlock(&pid_lock, "nextpid");
+  initlock(&ptable.lock, "ptable");
+}
+
+// First proc of the first chunk, for walking every
+// struct proc without holding ptable.lock.
+// Caller must not pass through the scheduler until
+// it is done with the walk (e.g. hold a spinlock).
+struct proc*
+procfirst(void)
 {
+  struct procchunk *ch = __atomic_load_n(&ptable.chunks, __ATOMIC_ACQUIRE);
+
+  return ch ? ch->procs : 0;
+}
+
+// The struct proc after p, or 0 at the end of the walk.
+struct proc*
+procnext(struct proc *p)
+{
+  struct procchunk *ch = PROCCHUNK(p);
+
+  if(++p < &ch->procs[NPROCCHUNK])
+    return p;
+  ch = __atomic_load_n(&ch->next, __ATOMIC_ACQUIRE);
+  return ch ? ch->procs : 0;
+}
+
+static void
+freelist_push(struct proc *p)
+{
+  p->freeprev = 0;
+  p->freenext = ptable.freelist;
+  if(ptable.freelist)
+    ptable.freelist->freeprev = p;
+  ptable.freelist = p;
+  PROCCHUNK(p)->nfree++;
+}
+
+static void
+freelist_remove(struct proc *p)
+{
+  if(p->freeprev)
+    p->freeprev->freenext = p->freenext;
+  else
+    ptable.freelist = p->freenext;
+  if(p->freenext)
+    p->freenext->freeprev = p->freeprev;
+  p->freenext = p->freeprev = 0;
+  PROCCHUNK(p)->nfree--;
+}
+
+// Carve a fresh page into UNUSED procs.
+// Caller must hold ptable.lock.
+// Returns -1 if out of memory.
+static int
+procgrow(void)
+{
+  struct procchunk *ch;
   struct proc *p;
-  
-  for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
-    if(pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int) (p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
+
+  if((ch = (struct procchunk *)kalloc()) == 0)
+    return -1;
+  memset(ch, 0, PGSIZE);
+  for(p = ch->procs; p < &ch->procs[NPROCCHUNK]; p++){
+    initlock(&p->lock, "proc");
+    initlock(&p->childlock, "childlock");
+    p->state = UNUSED;
+    freelist_push(p);
   }
+
+  // publish the initialized procs to lock-free walkers.
+  ch->next = ptable.chunks;
+  __atomic_store_n(&ptable.chunks, ch, __ATOMIC_RELEASE);
+  return 0;
 }
 
-// initialize the proc table.
+// Unlink a chunk whose procs are all free from the
+// chunk list and park it until it is safe to free.
+// Caller must hold ptable.lock.
+static void
+procretire(struct procchunk *ch)
+{
+  struct procchunk **pp;
+  struct proc *p;
+
+  for(p = ch->procs; p < &ch->procs[NPROCCHUNK]; p++)
+    freelist_remove(p);
+
+  for(pp = &ptable.chunks; *pp != ch; pp = &(*pp)->next)
+    ;
+  // ch->next stays intact for walkers still inside ch.
+  __atomic_store_n(pp, ch->next, __ATOMIC_RELEASE);
+
+  for(int i = 0; i < NCPU; i++)
+    ch->qs[i] = __atomic_load_n(&cpus[i].qs, __ATOMIC_ACQUIRE);
+  ch->limbonext = ptable.limbo;
+  ptable.limbo = ch;
+}
+
+// Free retired chunks that no CPU can still be looking at:
+// every CPU has been through the top of scheduler() since
+// the chunk was unlinked, or has never run it at all.
 void
-procinit(void)
+proc_reclaim(void)
+{
+  struct procchunk **pp, *ch;
+  int i;
+
+  acquire(&ptable.lock);
+  for(pp = &ptable.limbo; (ch = *pp) != 0; ){
+    for(i = 0; i < NCPU; i++){
+      uint64 qs = __atomic_load_n(&cpus[i].qs, __ATOMIC_ACQUIRE);
+      if(qs != 0 && qs == ch->qs[i])
+        break;
+    }
+    if(i < NCPU){
+      pp = &ch->limbonext;
+      continue;
+    }
+    *pp = ch->limbonext;
+    kfree((void*)ch);
+  }
+  release(&ptable.lock);
+}
+
+// Return an UNUSED proc to the free list, retiring
+// its chunk if that leaves the whole chunk free.
+// p->lock must be held.
+static void
+procfree(struct proc *p)
+{
+  struct procchunk *ch = PROCCHUNK(p);
+
+  acquire(&ptable.lock);
+  freelist_push(p);
+  if(ch->nfree == NPROCCHUNK)
+    procretire(ch);
+  release(&ptable.lock);
+}
+
+// Number of harts that have started scheduling.
+int
+ncpus(void)
+{
+  int n = 0;
+
+  for(int i = 0; i < NCPU; i++)
+    if(__atomic_load_n(&cpus[i].qs, __ATOMIC_RELAXED) != 0)
+      n++;
+  return n;
+}
+
+// Look up a process by pid.
+// Returns with p->lock held, or 0 if there is no such process,
+// or if try is set and someone else holds its lock.
+struct proc*
+findproc(int pid, int try)
 {
   struct proc *p;
-  
-  initlock(&pid_lock, "nextpid");
-  initlock(&wait_lock, "wait_lock");
-  for(p = proc; p < &proc[NPROC]; p++) {
-      initlock(&p->lock, "proc");
-      p->state = UNUSED;
-      p->kstack = KSTACK((int) (p - proc));
+
+  // keep interrupts off from the hash lookup until p->lock is
+  // held, so this CPU can't pass through the scheduler and let
+  // proc_reclaim() free p's chunk in between.
+  push_off();
+  acquire(&ptable.lock);
+  for(p = ptable.pidhash[PIDHASH(pid)]; p; p = p->pidnext)
+    if(p->pid == pid)
+      break;
+  release(&ptable.lock);
+  if(p && try && !tryacquire(&p->lock))
+    p = 0;
+  else if(p && !try)
+    acquire(&p->lock);
+  if(p){
+    // p may have been freed and reused since we dropped ptable.lock.
+    if(p->pid != pid || p->state == UNUSED){
+      release(&p->lock);
+      p = 0;
+    }
   }
+  pop_off();
+  return p;
 }
 
 // Must be called with interrupts disabled,
@@ -152,33 +340,54 @@ allocpid()
   return pid;
 }
 
-// Look in the process table for an UNUSED proc.
+// Take an UNUSED proc off the free list, growing the
+// process table if the free list is empty.
 // If found, initialize state required to run in the kernel,
 // and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
+// If a memory allocation fails, return 0.
 static struct proc*
 allocproc(void)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
-      release(&p->lock);
-    }
+  acquire(&ptable.lock);
+  if(ptable.freelist == 0 && procgrow() < 0){
+    release(&ptable.lock);
+    return 0;
   }
-  return 0;
+  p = ptable.freelist;
+  freelist_remove(p);
+  release(&ptable.lock);
 
-found:
+  // p is off the free list, so no one else can allocate it,
+  // and its chunk can't be retired.
+  acquire(&p->lock);
+  if(p->state != UNUSED)
+    panic("allocproc");
   p->pid = allocpid();
   p->state = USED;
 
+  acquire(&ptable.lock);
+  p->pidnext = ptable.pidhash[PIDHASH(p->pid)];
+  ptable.pidhash[PIDHASH(p->pid)] = p;
+  release(&ptable.lock);
+
   // ============= NEW CODE: Initialize MLFQ fields =============
   init_mlfq_proc(p);  // Initialize MLFQ scheduling fields for new process
   // ============= END OF NEW CODE =============
 
+  p->nfault = 0;
+  p->nmajfault = 0;
+  p->oomwait = 0;
+  p->nofault = 0;
+
+  // Allocate a kernel stack page, mapped above a guard page.
+  if((p->kstack = kstackalloc()) == 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
     freeproc(p);
@@ -204,25 +413,46 @@ found:
 }
 
 // free a proc structure and the data hanging from it,
-// including user pages.
+// including user pages and the kernel stack, and put
+// it back on the free list.
 // p->lock must be held.
 static void
 freeproc(struct proc *p)
 {
+  struct proc **pp;
+
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
+  if(p->kstack)
+    kstackfree(p->kstack);
+  p->kstack = 0;
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
+  p->asidgen = 0;
   p->sz = 0;
-  p->pid = 0;
   p->parent = 0;
+  p->sibnext = 0;
+  p->sibprev = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+
+  acquire(&ptable.lock);
+  for(pp = &ptable.pidhash[PIDHASH(p->pid)]; *pp; pp = &(*pp)->pidnext){
+    if(*pp == p){
+      *pp = p->pidnext;
+      break;
+    }
+  }
+  p->pidnext = 0;
+  release(&ptable.lock);
+
+  p->pid = 0;
   p->state = UNUSED;
+  procfree(p);
 }
 
 // Create a user page table for a given process, with no user memory,
@@ -295,7 +525,7 @@ growproc(int n)
 
   sz = p->sz;
   if(n > 0){
-    if(sz + n > TRAPFRAME) {
+    if(sz + n > vmaheaptop(p)) {
       return -1;
     }
     if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
@@ -313,7 +543,7 @@ growproc(int n)
 int
 kfork(void)
 {
-  int i, pid;
+  int i, pid, r;
   struct proc *np;
   struct proc *p = myproc();
 
@@ -330,6 +560,16 @@ kfork(void)
   }
   np->sz = p->sz;
 
+  // vmadup() may read in pages, so can't hold np->lock.
+  release(&np->lock);
+  r = vmadup(np, p);
+  acquire(&np->lock);
+  if(r < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
 
@@ -348,9 +588,10 @@ kfork(void)
 
   release(&np->lock);
 
-  acquire(&wait_lock);
+  acquire(&p->childlock);
   np->parent = p;
-  release(&wait_lock);
+  child_insert(&p->children, np);
+  release(&p->childlock);
 
   acquire(&np->lock);
   np->state = RUNNABLE;
@@ -359,18 +600,79 @@ kfork(void)
   return pid;
 }
 
+// Push c onto the front of a children or zombies list.
+// Caller must hold the owning parent's childlock.
+static void
+child_insert(struct proc **head, struct proc *c)
+{
+  c->sibprev = 0;
+  c->sibnext = *head;
+  if(*head)
+    (*head)->sibprev = c;
+  *head = c;
+}
+
+// Unlink c from a children or zombies list.
+// Caller must hold the owning parent's childlock.
+static void
+child_remove(struct proc **head, struct proc *c)
+{
+  if(c->sibprev)
+    c->sibprev->sibnext = c->sibnext;
+  else
+    *head = c->sibnext;
+  if(c->sibnext)
+    c->sibnext->sibprev = c->sibprev;
+  c->sibnext = 0;
+  c->sibprev = 0;
+}
+
 // Pass p's abandoned children to init.
-// Caller must hold wait_lock.
+// Caller must hold p->childlock.
 void
 reparent(struct proc *p)
 {
   struct proc *pp;
+  int zombies = 0;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
-    }
+  if(p->children == 0 && p->zombies == 0)
+    return;
+
+  acquire(&initproc->childlock);
+  while((pp = p->children) != 0){
+    child_remove(&p->children, pp);
+    pp->parent = initproc;
+    child_insert(&initproc->children, pp);
+  }
+  while((pp = p->zombies) != 0){
+    child_remove(&p->zombies, pp);
+    pp->parent = initproc;
+    child_insert(&initproc->zombies, pp);
+    zombies = 1;
+  }
+  if(zombies)
+    wakeup(initproc);
+  release(&initproc->childlock);
+}
+
+// Lock and return p's parent. p->parent can change
+// under us while the parent is exiting (reparent()),
+// so re-check it once the parent's childlock is held.
+static struct proc*
+lockparent(struct proc *p)
+{
+  struct proc *pp;
+
+  for(;;){
+    // interrupts stay off between loading p->parent and locking
+    // it, so pp's chunk can't be reclaimed in between.
+    push_off();
+    pp = __atomic_load_n(&p->parent, __ATOMIC_ACQUIRE);
+    acquire(&pp->childlock);
+    pop_off();
+    if(p->parent == pp)
+      return pp;
+    release(&pp->childlock);
   }
 }
 
@@ -394,18 +696,29 @@ kexit(int status)
     }
   }
 
+  vmafree(p);
+  // give back user memory now rather than when the parent
+  // waits, for the processes oomkill() made room for.
+  p->sz = uvmdealloc(p->pagetable, p->sz, 0);
+
   begin_op();
   iput(p->cwd);
   end_op();
   p->cwd = 0;
 
-  acquire(&wait_lock);
-
   // Give any children to init.
+  acquire(&p->childlock);
   reparent(p);
+  release(&p->childlock);
+
+  struct proc *pp = lockparent(p);
+
+  // Move to the parent's zombie list so wait() needn't search.
+  child_remove(&pp->children, p);
+  child_insert(&pp->zombies, p);
 
   // Parent might be sleeping in wait().
-  wakeup(p->parent);
+  wakeup(pp);
   
   acquire(&p->lock);
 
@@ -413,7 +726,7 @@ kexit(int status)
   p->state = ZOMBIE;
   p->end_time = ticks;  // Record end time for performance metrics
 
-  release(&wait_lock);
+  release(&pp->childlock);
 
   // Jump into the scheduler, never to return.
   sched();
@@ -426,46 +739,45 @@ int
 kwait(uint64 addr)
 {
   struct proc *pp;
-  int havekids, pid;
+  int pid, xstate;
   struct proc *p = myproc();
 
-  acquire(&wait_lock);
+  acquire(&p->childlock);
 
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(pp = proc; pp < &proc[NPROC]; pp++){
-      if(pp->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&pp->lock);
-
-        havekids = 1;
-        if(pp->state == ZOMBIE){
-          // Found one.
-          pid = pp->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
-                                  sizeof(pp->xstate)) < 0) {
-            release(&pp->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(pp);
-          release(&pp->lock);
-          release(&wait_lock);
-          return pid;
-        }
+    // Exited children are kept on their own list.
+    if((pp = p->zombies) != 0){
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&pp->lock);
+
+      pid = pp->pid;
+      xstate = pp->xstate;
+      if(addr != 0){
+        // copyout() may fault a page in and sleep, so not
+        // with the locks held. only p reaps its zombies,
+        // so pp stays on the list in the meantime.
         release(&pp->lock);
+        release(&p->childlock);
+        if(copyout(p->pagetable, addr, (char *)&xstate, sizeof(xstate)) < 0)
+          return -1;
+        acquire(&p->childlock);
+        acquire(&pp->lock);
       }
+      child_remove(&p->zombies, pp);
+      freeproc(pp);
+      release(&pp->lock);
+      release(&p->childlock);
+      return pid;
     }
 
     // No point waiting if we don't have any children.
-    if(!havekids || killed(p)){
-      release(&wait_lock);
+    if(p->children == 0 || killed(p)){
+      release(&p->childlock);
       return -1;
     }
     
     // Wait for a child to exit.
-    sleep(p, &wait_lock);  //DOC: wait-sleep
+    sleep(p, &p->childlock);  //DOC: wait-sleep
   }
 }
 
@@ -496,7 +808,7 @@ scheduler(void)
     intr_off();
 
     int found = 0;
-    for(p = proc; p < &proc[NPROC]; p++) {
+    for(p = procfirst(); p; p = procnext(p)) {
       acquire(&p->lock);
       if(p->state == RUNNABLE) {
         // Switch to chosen process.  It is the process's job
@@ -536,10 +848,15 @@ scheduler(void)
     intr_on();
     intr_off();
 
+    // this CPU holds no pointers into the process table here.
+    __atomic_fetch_add(&c->qs, 1, __ATOMIC_RELEASE);
+    if(__atomic_load_n(&ptable.limbo, __ATOMIC_RELAXED))
+      proc_reclaim();
+
     int found = 0;
     
     for(int priority = MLFQ_HIGH; priority <= MLFQ_LOW; priority++) {
-      for(p = proc; p < &proc[NPROC]; p++) {
+      for(p = procfirst(); p; p = procnext(p)) {
         acquire(&p->lock);
         if(p->state == RUNNABLE && p->priority == priority) {
           // Found a runnable process
@@ -555,6 +872,9 @@ scheduler(void)
           p->total_wait += (ticks - p->last_scheduled);
           
           // === REMOVED: timeslice_used reset and demotion logic from here ===
+          // p's stack slot may have held another stack, or nothing,
+          // when this hart last used it; see kstackalloc().
+          sfence_vma_page(p->kstack, 0);
           // Just do the context switch
           swtch(&c->context, &p->context);
 
@@ -572,7 +892,15 @@ scheduler(void)
     }
     
     if(found == 0) {
-      asm volatile("wfi");
+      // nothing to run; zero free pages for kalloc_zeroed(),
+      // look for pages to merge, and only stop until an
+      // interrupt once there's nothing left to do.
+      int busy = kzero_fill();
+#ifdef KSM
+      busy += ksmscan();
+#endif
+      if(busy == 0)
+        asm volatile("wfi");
     }
   }
 }
@@ -714,7 +1042,7 @@ forkret(void)
 
   // return to user space, mimicing usertrap()'s return.
   prepare_return();
-  uint64 satp = MAKE_SATP(p->pagetable);
+  uint64 satp = MAKE_SATP(p->pagetable, asidget(p));
   uint64 trampoline_userret = TRAMPOLINE + (userret - trampoline);
   ((void (*)(uint64))trampoline_userret)(satp);
 }
@@ -757,7 +1085,7 @@ wakeup(void *chan)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  for(p = procfirst(); p; p = procnext(p)) {
     if(p != myproc()){
       acquire(&p->lock);
       if(p->state == SLEEPING && p->chan == chan) {
@@ -776,20 +1104,15 @@ kkill(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-      return 0;
-    }
-    release(&p->lock);
+  if((p = findproc(pid, 0)) == 0)
+    return -1;
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    p->state = RUNNABLE;
   }
-  return -1;
+  release(&p->lock);
+  return 0;
 }
 
 void
@@ -859,7 +1182,7 @@ procdump(void)
   char *state;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
+  for(p = procfirst(); p; p = procnext(p)){
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
@@ -877,42 +1200,41 @@ procdump(void)
 int
 getprocinfo(int pid, uint64 addr)
 {
-  struct proc *p;                    // Pointer to iterate through process table
+  struct proc *p;                    // Process being queried
   struct proc *current = myproc();   // Current calling process
   struct procinfo info;             // Structure to hold process information
   
-  // Search for process with matching PID in the process table
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);               // Acquire lock to safely read process data
-    
-    // Check if this is the process we're looking for and it's active
-    if(p->pid == pid && p->state != UNUSED) {
-      // Found the process - collect performance information
-      info.pid = p->pid;             // Process ID
-      info.priority = p->priority;   // Current priority level (0=high, 2=low)
-      info.cpu_ticks = p->cpu_ticks; // Total CPU ticks consumed by process
-      info.sched_count = p->sched_count;     // Number of times process was scheduled
-      info.timeslice_used = p->timeslice_used; // Ticks used in current time slice
-      
-      // Timing metrics for comparison
-      info.start_time = p->start_time;       // When process was created
-      info.end_time = p->end_time;           // When process finished (0 if running)
-      info.first_run = p->first_run;         // When process was first scheduled
-      info.total_wait = p->total_wait;       // Total accumulated wait time
-      
-      release(&p->lock);             // Release lock before copying to user space
-      
-      // Copy information structure to user space at provided address
-      if(copyout(current->pagetable, addr, (char *)&info, sizeof(info)) < 0) {
-        return -1;                   // Failed to copy to user space
-      }
-      
-      return 0;                      // Success - information copied successfully
-    }
-    
-    release(&p->lock);               // Release lock if this wasn't the right process
+  // Look the PID up in the pid hash; returns with p->lock held
+  if((p = findproc(pid, 0)) == 0)
+    return -1;                       // Process not found with given PID
+
+  // Found the process - collect performance information
+  info.pid = p->pid;             // Process ID
+  info.priority = p->priority;   // Current priority level (0=high, 2=low)
+  info.cpu_ticks = p->cpu_ticks; // Total CPU ticks consumed by process
+  info.sched_count = p->sched_count;     // Number of times process was scheduled
+  info.timeslice_used = p->timeslice_used; // Ticks used in current time slice
+  
+  // Timing metrics for comparison
+  info.start_time = p->start_time;       // When process was created
+  info.end_time = p->end_time;           // When process finished (0 if running)
+  info.first_run = p->first_run;         // When process was first scheduled
+  info.total_wait = p->total_wait;       // Total accumulated wait time
+
+  // Memory use
+  info.rss = info.nswapped = info.nptpages = 0;
+  if(p->pagetable)
+    uvmusage(p->pagetable, &info.rss, &info.nswapped, &info.nptpages);
+  info.nfault = p->nfault;
+  info.nmajfault = p->nmajfault;
+  
+  release(&p->lock);             // Release lock before copying to user space
+  
+  // Copy information structure to user space at provided address
+  if(copyout(current->pagetable, addr, (char *)&info, sizeof(info)) < 0) {
+    return -1;                   // Failed to copy to user space
   }
   
-  return -1;                         // Process not found with given PID
+  return 0;                      // Success - information copied successfully
 }
 // ============= END OF NEW SYSTEM CALL =============
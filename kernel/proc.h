@@ -26,6 +26,8 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint64 qs;                  // Passes through the scheduler loop; see proc_reclaim().
+  uint64 asidgen;             // ASID generation this hart's TLB was last flushed for
 };
 
 extern struct cpu cpus[NCPU];
@@ -108,10 +110,28 @@ struct procinfo {
   uint64 end_time;      // Time when process finished (0 if still running)
   uint64 first_run;     // Time when process was first scheduled
   uint64 total_wait;    // Total time spent waiting to be scheduled
+  uint64 rss;           // user pages mapped (resident)
+  uint64 nswapped;      // user pages swapped out
+  uint64 nptpages;      // page-table pages
+  uint64 nfault;        // page faults served
+  uint64 nmajfault;     // of those, read back in from swap
 };
 
 // =====End Of Modified Code ======
 
+// A region of a process's memory: an ELF segment or the user
+// stack mapped by exec(), or a mapping made by mmap(). See vma.c.
+struct vma {
+  uint64 start;                // page-aligned; start == end if unused
+  uint64 end;
+  struct inode *ip;            // backing file, or 0 if anonymous
+  uint off;                    // file offset of start
+  uint filesz;                 // bytes from the file; the rest is zero
+  int perm;                    // PTE_R, PTE_W, PTE_X
+  int flags;                   // MAP_SHARED or MAP_PRIVATE for mmap(),
+                               // 0 for exec() segments, which lie below p->sz
+};
+
 // Per-process state
 struct proc {
   struct spinlock lock;
@@ -122,18 +142,39 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int kpreempt;                // Preempted in kernel code; see swap.c
 
-  // wait_lock must be held when using this:
+  // parent->childlock must be held when using these:
   struct proc *parent;         // Parent process
+  struct proc *sibnext;        // Next in parent's children or zombies list
+  struct proc *sibprev;        // Previous in parent's children or zombies list
+
+  // childlock must be held when using these:
+  struct spinlock childlock;   // protects children, zombies and their parent links
+  struct proc *children;       // Live children
+  struct proc *zombies;        // Exited children not yet wait()ed for
+
+  // ptable.lock must be held when using these:
+  struct proc *freenext;       // Free list links, while UNUSED
+  struct proc *freeprev;
+  struct proc *pidnext;        // Next in pid hash bucket
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
+  uint asid;                   // TLB tag for pagetable; see asid.c
+  uint64 asidgen;              // Generation of asid, 0 if none yet
+  int asidcpu;                 // Hart whose TLB is up to date for asid
   struct trapframe *trapframe; // data page for trampoline.S
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  struct vma vmas[NVMA];       // exec() and mmap() memory regions
+  uint64 nfault;               // page faults served by vmfault()
+  uint64 nmajfault;            // of those, swapped-out pages read back
+  int oomwait;                 // vmfault() ran out of memory; see oom.c
+  int nofault;                 // copyin()/copyout() mustn't fault; see fileread()
   char name[16];               // Process name (debugging)
 
 
@@ -41,6 +41,7 @@ w_mepc(uint64 x)
 
 // Supervisor Status Register, sstatus
 
+#define SSTATUS_VS (3L << 9)   // Vector unit state, 0=Off
 #define SSTATUS_SPP (1L << 8)  // Previous mode, 1=Supervisor, 0=User
 #define SSTATUS_SPIE (1L << 5) // Supervisor Previous Interrupt Enable
 #define SSTATUS_UPIE (1L << 4) // User Previous Interrupt Enable
@@ -222,7 +223,12 @@ w_pmpaddr0(uint64 x)
 // use riscv's sv39 page table scheme.
 #define SATP_SV39 (8L << 60)
 
-#define MAKE_SATP(pagetable) (SATP_SV39 | (((uint64)pagetable) >> 12))
+#define SATP_ASIDSHIFT 44
+#define SATP_ASIDMASK (0xFFFFL << SATP_ASIDSHIFT)
+
+// the kernel's page table runs with ASID 0; see asid.c.
+#define MAKE_SATP(pagetable, asid) \
+  (SATP_SV39 | ((uint64)(asid) << SATP_ASIDSHIFT) | (((uint64)pagetable) >> 12))
 
 // supervisor address translation and protection;
 // holds the address of the page table.
@@ -344,6 +350,20 @@ sfence_vma()
   asm volatile("sfence.vma zero, zero");
 }
 
+// flush the TLB entries of one address space.
+static inline void
+sfence_vma_asid(uint64 asid)
+{
+  asm volatile("sfence.vma zero, %0" : : "r" (asid));
+}
+
+// flush the TLB entry for one page of one address space.
+static inline void
+sfence_vma_page(uint64 va, uint64 asid)
+{
+  asm volatile("sfence.vma %0, %1" : : "r" (va), "r" (asid));
+}
+
 typedef uint64 pte_t;
 typedef uint64 *pagetable_t; // 512 PTEs
 
@@ -360,6 +380,10 @@ typedef uint64 *pagetable_t; // 512 PTEs
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // user can access
+#define PTE_A (1L << 6) // accessed
+#define PTE_D (1L << 7) // dirty
+#define PTE_COW (1L << 8) // copy-on-write; one of the RSW bits
+#define PTE_HUGE (1L << 9) // user 2 MiB page; the other RSW bit
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
@@ -368,11 +392,21 @@ typedef uint64 *pagetable_t; // 512 PTEs
 
 #define PTE_FLAGS(pte) ((pte) & 0x3FF)
 
+// a user PTE with PTE_V clear but other bits set is a page
+// swapped out to the slot in its PPN field (see swap.c).
+#define PTE_SWAPPED(pte) (((pte) & PTE_V) == 0 && (pte) != 0)
+#define PTE2SLOT(pte) ((pte) >> 10)
+#define SLOT2PTE(slot) (((uint64)(slot)) << 10)
+
 // extract the three 9-bit page table indices from a virtual address.
 #define PXMASK          0x1FF // 9 bits
 #define PXSHIFT(level)  (PGSHIFT+(9*(level)))
 #define PX(level, va) ((((uint64) (va)) >> PXSHIFT(level)) & PXMASK)
 
+// 2 MiB megapages, mapped by a level-1 PTE.
+#define HUGEPGSIZE (1L << PXSHIFT(1))
+#define HUGEPGROUNDDOWN(a) (((a)) & ~(HUGEPGSIZE-1))
+
 // one beyond the highest possible virtual address.
 // MAXVA is actually one bit less than the max allowed by
 // Sv39, to avoid having to sign-extend virtual addresses
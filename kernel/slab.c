@@ -0,0 +1,323 @@
+// Object caches ("slabs") for small kernel objects,
+// layered on kalloc().
+//
+// A cache hands out objects of one size, carved out of whole
+// pages (slabs) that start with a struct slab header. Each hart
+// has a magazine of recently freed objects per cache, so most
+// allocations and frees don't touch the cache's lock. kmalloc()
+// and kmfree() sit on top of a set of power-of-two caches.
+//
+// A slab whose objects are all free goes straight back to
+// kalloc(); when kalloc() runs dry it calls slab_reclaim() to
+// empty the magazines, which may free more slabs.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "kalloc.h"
+#include "defs.h"
+
+#define NSLABCACHE  16   // maximum number of caches
+#define MAGSIZE     16   // objects per per-hart magazine
+
+#define KMALLOC_MINSHIFT 4   // smallest kmalloc() size: 16 bytes
+#define KMALLOC_MAXSHIFT 11  // largest kmalloc() size: 2048 bytes
+
+struct obj {
+  struct obj *next;
+};
+
+// at the start of every slab page.
+struct slab {
+  struct kmem_cache *cache;
+  struct slab *next;       // cache's partial or full list
+  struct slab *prev;
+  struct obj *free;        // free objects in this slab
+  int inuse;               // objects not on free
+};
+
+#define SLABHDR ((sizeof(struct slab) + 15) & ~15)
+
+struct magazine {
+  struct spinlock lock;    // only contended by slab_reclaim()
+  int n;
+  void *objs[MAGSIZE];
+  uint64 nalloc;           // objects handed out on this hart
+  uint64 nfree;            // objects given back on this hart
+};
+
+struct kmem_cache {
+  struct spinlock lock;    // protects the slab lists and nslabs
+  char name[16];
+  uint size;               // object size, rounded up to 16
+  uint perslab;            // objects per slab
+  struct slab *partial;    // slabs with some free objects
+  struct slab *full;       // slabs with none
+  uint64 nslabs;
+  struct magazine mag[NCPU];
+};
+
+static struct {
+  struct spinlock lock;
+  int n;
+  struct kmem_cache caches[NSLABCACHE];
+} slabs;
+
+static struct kmem_cache *kmalloc_caches[KMALLOC_MAXSHIFT+1];
+static char *kmalloc_names[KMALLOC_MAXSHIFT+1] = {
+  [4] "kmalloc-16", [5] "kmalloc-32", [6] "kmalloc-64", [7] "kmalloc-128",
+  [8] "kmalloc-256", [9] "kmalloc-512", [10] "kmalloc-1024", [11] "kmalloc-2048",
+};
+
+void
+slabinit(void)
+{
+  initlock(&slabs.lock, "slabs");
+  for(int s = KMALLOC_MINSHIFT; s <= KMALLOC_MAXSHIFT; s++)
+    kmalloc_caches[s] = kmem_cache_create(kmalloc_names[s], 1 << s);
+}
+
+// Create a cache of objects of the given size, which must
+// leave room for at least one object in a page.
+struct kmem_cache*
+kmem_cache_create(char *name, uint size)
+{
+  struct kmem_cache *c;
+
+  size = (size + 15) & ~15;
+  if(size == 0 || size > PGSIZE - SLABHDR)
+    panic("kmem_cache_create: size");
+
+  acquire(&slabs.lock);
+  if(slabs.n >= NSLABCACHE)
+    panic("kmem_cache_create: too many caches");
+  c = &slabs.caches[slabs.n];
+  memset(c, 0, sizeof(*c));
+  initlock(&c->lock, "kmem_cache");
+  safestrcpy(c->name, name, sizeof(c->name));
+  c->size = size;
+  c->perslab = (PGSIZE - SLABHDR) / size;
+  for(int i = 0; i < NCPU; i++)
+    initlock(&c->mag[i].lock, "magazine");
+  // publish only once initialized, for slab_reclaim() and slabinfo().
+  __atomic_store_n(&slabs.n, slabs.n + 1, __ATOMIC_RELEASE);
+  release(&slabs.lock);
+  return c;
+}
+
+static void
+slab_unlink(struct slab **head, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    *head = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+  s->next = s->prev = 0;
+}
+
+static void
+slab_push(struct slab **head, struct slab *s)
+{
+  s->prev = 0;
+  s->next = *head;
+  if(*head)
+    (*head)->prev = s;
+  *head = s;
+}
+
+// Add a fresh slab page to c.
+// Must be called without any slab locks held,
+// since kalloc() may call slab_reclaim().
+// Returns -1 if out of memory.
+static int
+cache_grow(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *o;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return -1;
+  s->cache = c;
+  s->inuse = 0;
+  s->free = 0;
+  for(o = (char*)s + SLABHDR + (c->perslab - 1) * c->size; o >= (char*)s + SLABHDR; o -= c->size){
+    ((struct obj*)o)->next = s->free;
+    s->free = (struct obj*)o;
+  }
+
+  acquire(&c->lock);
+  slab_push(&c->partial, s);
+  c->nslabs++;
+  release(&c->lock);
+  return 0;
+}
+
+// Fill magazine m with up to MAGSIZE/2 objects from c's slabs.
+// Caller must hold m->lock.
+static void
+cache_refill(struct kmem_cache *c, struct magazine *m)
+{
+  struct slab *s;
+
+  acquire(&c->lock);
+  while(m->n < MAGSIZE/2 && (s = c->partial) != 0){
+    struct obj *o = s->free;
+    s->free = o->next;
+    s->inuse++;
+    m->objs[m->n++] = o;
+    if(s->free == 0){
+      slab_unlink(&c->partial, s);
+      slab_push(&c->full, s);
+    }
+  }
+  release(&c->lock);
+}
+
+// Return n objects from magazine m to their slabs, and give
+// slabs that become empty back to kalloc().
+// Caller must hold m->lock.
+static void
+cache_flush(struct kmem_cache *c, struct magazine *m, int n)
+{
+  acquire(&c->lock);
+  while(n-- > 0 && m->n > 0){
+    struct obj *o = m->objs[--m->n];
+    struct slab *s = (struct slab*)PGROUNDDOWN((uint64)o);
+    if(s->free == 0){
+      slab_unlink(&c->full, s);
+      slab_push(&c->partial, s);
+    }
+    o->next = s->free;
+    s->free = o;
+    if(--s->inuse == 0){
+      slab_unlink(&c->partial, s);
+      c->nslabs--;
+      kfree((void*)s);
+    }
+  }
+  release(&c->lock);
+}
+
+// Allocate an object from cache c.
+// Returns 0 if out of memory.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct magazine *m;
+  void *o;
+
+  for(;;){
+    push_off();
+    m = &c->mag[cpuid()];
+    acquire(&m->lock);
+    if(m->n == 0)
+      cache_refill(c, m);
+    if(m->n > 0){
+      o = m->objs[--m->n];
+      m->nalloc++;
+      release(&m->lock);
+      pop_off();
+      return o;
+    }
+    release(&m->lock);
+    pop_off();
+
+    if(cache_grow(c) < 0)
+      return 0;
+  }
+}
+
+// Give an object back to the cache it came from.
+void
+kmem_cache_free(struct kmem_cache *c, void *o)
+{
+  struct magazine *m;
+
+  if(((struct slab*)PGROUNDDOWN((uint64)o))->cache != c)
+    panic("kmem_cache_free");
+
+  push_off();
+  m = &c->mag[cpuid()];
+  acquire(&m->lock);
+  if(m->n == MAGSIZE)
+    cache_flush(c, m, MAGSIZE/2);
+  m->objs[m->n++] = o;
+  m->nfree++;
+  release(&m->lock);
+  pop_off();
+}
+
+// Allocate n bytes, for n up to 2048.
+// Larger buffers should come from kalloc_order().
+// Returns 0 if out of memory.
+void*
+kmalloc(uint n)
+{
+  int s;
+
+  for(s = KMALLOC_MINSHIFT; s <= KMALLOC_MAXSHIFT && (1 << s) < n; s++)
+    ;
+  if(s > KMALLOC_MAXSHIFT)
+    return 0;
+  return kmem_cache_alloc(kmalloc_caches[s]);
+}
+
+// Free memory from kmalloc(), or any kmem_cache_alloc().
+void
+kmfree(void *o)
+{
+  kmem_cache_free(((struct slab*)PGROUNDDOWN((uint64)o))->cache, o);
+}
+
+// Empty every magazine back into its slabs, so that
+// slabs with no objects in use return to kalloc().
+// Called by kalloc() when it runs out of pages; the
+// caller must not hold any slab locks.
+// Returns the number of pages freed.
+int
+slab_reclaim(void)
+{
+  int n = __atomic_load_n(&slabs.n, __ATOMIC_ACQUIRE);
+  uint64 before = 0, after = 0;
+
+  for(int i = 0; i < n; i++){
+    struct kmem_cache *c = &slabs.caches[i];
+    before += c->nslabs;
+    for(int j = 0; j < NCPU; j++){
+      acquire(&c->mag[j].lock);
+      cache_flush(c, &c->mag[j], MAGSIZE);
+      release(&c->mag[j].lock);
+    }
+    after += c->nslabs;
+  }
+  return before - after;
+}
+
+// Usage statistics of the i'th cache, for the slabinfo()
+// system call. Returns -1 if there is no such cache.
+int
+slab_stats(int i, struct slabinfo *si)
+{
+  struct kmem_cache *c;
+
+  if(i < 0 || i >= __atomic_load_n(&slabs.n, __ATOMIC_ACQUIRE))
+    return -1;
+  c = &slabs.caches[i];
+
+  memset(si, 0, sizeof(*si));
+  safestrcpy(si->name, c->name, sizeof(si->name));
+  si->objsize = c->size;
+  si->perslab = c->perslab;
+  // the counters are only approximate while the cache is in use.
+  si->nslabs = c->nslabs;
+  for(int j = 0; j < NCPU; j++){
+    si->nalloc += c->mag[j].nalloc;
+    si->ncached += c->mag[j].n;
+    si->inuse += c->mag[j].nalloc - c->mag[j].nfree;
+  }
+  return 0;
+}
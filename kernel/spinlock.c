@@ -42,6 +42,21 @@ acquire(struct spinlock *lk)
   lk->cpu = mycpu();
 }
 
+// Acquire the lock if no one holds it, this cpu included.
+// Returns 1 if it did, 0 if not.
+int
+tryacquire(struct spinlock *lk)
+{
+  push_off();
+  if(__sync_lock_test_and_set(&lk->locked, 1) != 0){
+    pop_off();
+    return 0;
+  }
+  __sync_synchronize();
+  lk->cpu = mycpu();
+  return 1;
+}
+
 // Release the lock.
 void
 release(struct spinlock *lk)
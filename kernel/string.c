@@ -1,13 +1,68 @@
 #include "types.h"
+#include "riscv.h"
+#include "defs.h"
+
+// memset(), memmove() and memcmp() go a word at a time where
+// their arguments' alignment allows. A kernel built with
+// make RVV=1 does big ones with the vector unit instead, if
+// rvvinit() finds one.
+
+#define WORD sizeof(uint64)
+#define ALIGNED(p) (((uint64)(p) & (WORD - 1)) == 0)
+
+#ifdef RVV
+#define RVVMIN 256  // smaller than this isn't worth it
+
+static int rvv;     // the harts have the V extension
+
+// vstring.S
+void* rvv_memset(void*, int, uint);
+void* rvv_memmove(void*, const void*, uint);
+int rvv_memcmp(const void*, const void*, uint);
+#endif
+
+// Use the vector routines if sstatus.VS can be turned on,
+// which it can only on harts with the V extension.
+void
+rvvinit(void)
+{
+#ifdef RVV
+  w_sstatus(r_sstatus() | SSTATUS_VS);
+  rvv = (r_sstatus() & SSTATUS_VS) != 0;
+  w_sstatus(r_sstatus() & ~SSTATUS_VS);
+#endif
+}
 
 void*
 memset(void *dst, int c, uint n)
 {
   char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uint64 w, *wdst;
+
+#ifdef RVV
+  if(rvv && n >= RVVMIN){
+    // swtch() doesn't save the vector registers.
+    push_off();
+    rvv_memset(dst, c, n);
+    pop_off();
+    return dst;
   }
+#endif
+  for(; n > 0 && !ALIGNED(cdst); n--)
+    *cdst++ = c;
+  w = (uchar)c * 0x0101010101010101UL;
+  wdst = (uint64 *) cdst;
+  for(; n >= 4*WORD; n -= 4*WORD, wdst += 4){
+    wdst[0] = w;
+    wdst[1] = w;
+    wdst[2] = w;
+    wdst[3] = w;
+  }
+  for(; n >= WORD; n -= WORD)
+    *wdst++ = w;
+  cdst = (char *) wdst;
+  while(n-- > 0)
+    *cdst++ = c;
   return dst;
 }
 
@@ -18,6 +73,23 @@ memcmp(const void *v1, const void *v2, uint n)
 
   s1 = v1;
   s2 = v2;
+#ifdef RVV
+  if(rvv && n >= RVVMIN){
+    int r;
+    push_off();
+    r = rvv_memcmp(v1, v2, n);
+    pop_off();
+    return r;
+  }
+#endif
+  if(((uint64)s1 & (WORD - 1)) == ((uint64)s2 & (WORD - 1))){
+    for(; n > 0 && !ALIGNED(s1); n--, s1++, s2++)
+      if(*s1 != *s2)
+        return *s1 - *s2;
+    // skip equal words; the loop below finds the byte that differs.
+    for(; n >= WORD && *(uint64*)s1 == *(uint64*)s2; n -= WORD)
+      s1 += WORD, s2 += WORD;
+  }
   while(n-- > 0){
     if(*s1 != *s2)
       return *s1 - *s2;
@@ -41,11 +113,54 @@ memmove(void *dst, const void *src, uint n)
   if(s < d && s + n > d){
     s += n;
     d += n;
+    if(((uint64)s & (WORD - 1)) == ((uint64)d & (WORD - 1))){
+      for(; n > 0 && !ALIGNED(d); n--)
+        *--d = *--s;
+      for(; n >= WORD; n -= WORD){
+        d -= WORD;
+        s -= WORD;
+        *(uint64*)d = *(uint64*)s;
+      }
+    }
     while(n-- > 0)
       *--d = *--s;
-  } else
-    while(n-- > 0)
-      *d++ = *s++;
+    return dst;
+  }
+
+#ifdef RVV
+  if(rvv && n >= RVVMIN){
+    push_off();
+    rvv_memmove(dst, src, n);
+    pop_off();
+    return dst;
+  }
+#endif
+  for(; n > 0 && !ALIGNED(d); n--)
+    *d++ = *s++;
+  if(ALIGNED(s)){
+    for(; n >= 4*WORD; n -= 4*WORD, d += 4*WORD, s += 4*WORD){
+      ((uint64*)d)[0] = ((uint64*)s)[0];
+      ((uint64*)d)[1] = ((uint64*)s)[1];
+      ((uint64*)d)[2] = ((uint64*)s)[2];
+      ((uint64*)d)[3] = ((uint64*)s)[3];
+    }
+    for(; n >= WORD; n -= WORD, d += WORD, s += WORD)
+      *(uint64*)d = *(uint64*)s;
+  } else if(n >= WORD){
+    // read aligned words from s and shift each output word
+    // together from two of them. the last word read holds
+    // at least one byte that's needed, so is on a valid page.
+    int sh = ((uint64)s & (WORD - 1)) * 8;
+    uint64 *ws = (uint64*)((uint64)s & ~(WORD - 1));
+    uint64 lo = *ws++, hi;
+    for(; n >= WORD; n -= WORD, d += WORD, s += WORD){
+      hi = *ws++;
+      *(uint64*)d = (lo >> sh) | (hi << (64 - sh));
+      lo = hi;
+    }
+  }
+  while(n-- > 0)
+    *d++ = *s++;
 
   return dst;
 }
@@ -0,0 +1,337 @@
+// Swapping of user pages to a second virtio disk.
+//
+// When kalloc() runs out of pages it calls swapreclaim(), which
+// sweeps a clock hand over the user pages of processes that
+// aren't running. A page whose accessed bit (PTE_A) is set gets
+// a second chance: the bit is cleared, and the page is swapped
+// out only if the hand comes round again before it is touched.
+// Pages go to the compressed pool in memory (see zram.c) if they
+// compress well enough, and to the swap disk if not.
+//
+// A swapped-out page's PTE keeps its other flags but not PTE_V,
+// and holds the page's slot (see PTE2SLOT() in riscv.h): its
+// place on the swap disk, or ZSLOT plus its zram entry.
+// vmfault() reads it back in with swapin(). Only
+// private pages below p->sz that no one else shares are swapped
+// out. fork() shares a swapped-out page's slot, and each process
+// that faults it in gets a copy of its own.
+//
+// A page that doesn't compress well enough for zram, at a time
+// when the swap disk is full or missing, is marked rejected, and
+// the hand passes over it until it is written again (PTE_D), so
+// that it isn't compressed again on every sweep for nothing. (A
+// rejected page that is freed and reused keeps the mark until
+// its new owner writes it, which is almost always at once.)
+//
+// Otherwise a process's page table is changed only by the process
+// itself, so swapreclaim() leaves alone processes that are running
+// or were preempted in the middle of kernel code, and checks again,
+// after writing a page out, that it hasn't been used meanwhile.
+// Swap disk transfers poll instead of sleeping, so kalloc() can
+// reclaim pages whatever locks its caller holds.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "kalloc.h"
+#include "defs.h"
+
+#define SWAPMAX   16384  // most slots used: 64 MiB of swap
+#define SWAPBATCH 8      // pages swapped out per swapreclaim()
+#define SWAPSCAN  (2 * (PHYSTOP - KERNBASE) / PGSIZE)  // PTEs looked at, at most
+#define ZSLOT     0x80000000  // slots from here on are in zram
+
+static struct {
+  struct spinlock lock;    // protects slots and counters
+  uint nslots;             // slots on the swap disk; 0 if none
+  uint nused;
+  uint next;               // where to start looking for a free slot
+  ushort refs[SWAPMAX];    // PTEs referring to each slot; 0 if free
+  uint64 nout;             // pages swapped out to disk
+  uint64 nin;              // pages swapped in from disk
+  uint64 intime;           // time spent on those, in r_time() units
+  uint64 nzin;             // pages swapped in from zram
+  uint64 zintime;          // time spent on those
+
+  struct spinlock handlock;  // one swapreclaim() at a time
+  int handpid;             // the clock hand: the process
+  uint64 handva;           // and the address it's at
+  // with handlock: pages that had nowhere to go, by page number
+  uchar rejected[(PHYSTOP - KERNBASE) / PGSIZE / 8];
+} swap;
+
+#define PAGENO(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+#define REJECTED(pa) (swap.rejected[PAGENO(pa) / 8] & (1 << (PAGENO(pa) % 8)))
+
+void
+swapinit(void)
+{
+  uint64 n = virtio_swap_init() / PGSIZE;
+
+  initlock(&swap.lock, "swap");
+  initlock(&swap.handlock, "swaphand");
+  swap.nslots = n < SWAPMAX ? n : SWAPMAX;
+  zraminit();
+}
+
+// Allocate a swap slot. Returns -1 if the disk is full.
+static int
+slotalloc(void)
+{
+  int s = -1;
+
+  acquire(&swap.lock);
+  for(uint i = 0; i < swap.nslots; i++){
+    uint j = (swap.next + i) % swap.nslots;
+    if(swap.refs[j] == 0){
+      swap.refs[j] = 1;
+      swap.nused++;
+      swap.next = j + 1;
+      s = j;
+      break;
+    }
+  }
+  release(&swap.lock);
+  return s;
+}
+
+// Another PTE refers to slot, e.g. in a child made by fork().
+void
+swapdup(uint slot)
+{
+  if(slot & ZSLOT){
+    zramdup(slot & ~ZSLOT);
+    return;
+  }
+  acquire(&swap.lock);
+  if(slot >= swap.nslots || swap.refs[slot] == 0 || swap.refs[slot] == 0xffff)
+    panic("swapdup");
+  swap.refs[slot]++;
+  release(&swap.lock);
+}
+
+// A PTE no longer refers to slot.
+void
+swapfree(uint slot)
+{
+  if(slot & ZSLOT){
+    zramfree(slot & ~ZSLOT);
+    return;
+  }
+  acquire(&swap.lock);
+  if(slot >= swap.nslots || swap.refs[slot] == 0)
+    panic("swapfree");
+  if(--swap.refs[slot] == 0)
+    swap.nused--;
+  release(&swap.lock);
+}
+
+// Read the swapped-out page at va back in.
+// Returns its physical address, or 0 if out of memory.
+uint64
+swapin(pagetable_t pagetable, uint64 va)
+{
+  uint64 start = r_time();
+  pte_t *pte;
+  char *mem;
+  uint slot;
+
+  if((pte = walk(pagetable, va, 0)) == 0 || !PTE_SWAPPED(*pte))
+    return 0;
+  if((mem = kalloc()) == 0)
+    return 0;
+  slot = PTE2SLOT(*pte);
+  if(slot & ZSLOT)
+    zramget(slot & ~ZSLOT, mem);
+  else
+    virtio_swap_rw((uint64)slot * PGSIZE, mem, 0);
+  *pte = PA2PTE(mem) | PTE_FLAGS(*pte) | PTE_V | PTE_A;
+  tlbflushpage(pagetable, va);
+  swapfree(slot);
+  if(slot & ZSLOT){
+    __atomic_fetch_add(&swap.nzin, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&swap.zintime, r_time() - start, __ATOMIC_RELAXED);
+  } else {
+    __atomic_fetch_add(&swap.nin, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&swap.intime, r_time() - start, __ATOMIC_RELAXED);
+  }
+  return (uint64)mem;
+}
+
+// May p's page table be changed under it?
+// self is the caller of swapreclaim(), or 0.
+// Caller holds p->lock.
+int
+swappable(struct proc *p, struct proc *self)
+{
+  if(p->pagetable == 0)
+    return 0;
+  if(p == self)
+    return 1;
+  return (p->state == SLEEPING || p->state == RUNNABLE) && !p->kpreempt;
+}
+
+// Move the clock hand over p's pages, from swap.handva,
+// until it finds one to swap out, and write that one out.
+// Looks at no more than *budget PTEs.
+// Returns 1 if it swapped out a page, 0 if not, and -1
+// if the hand has reached the end of p's memory.
+static int
+swapone(struct proc *p, struct proc *self, uint64 *budget)
+{
+  pte_t *pte;
+  uint64 va, pa = 0;
+  int pid, slot, end, z;
+
+  if(!tryacquire(&p->lock))
+    return -1;
+  if(!swappable(p, self)){
+    release(&p->lock);
+    return -1;
+  }
+  pid = p->pid;
+  for(va = swap.handva; va < p->sz && *budget > 0; va += PGSIZE, (*budget)--){
+    if((pte = walk(p->pagetable, va, 0)) == 0){
+      // no page-table page here.
+      va = HUGEPGROUNDDOWN(va) + HUGEPGSIZE - PGSIZE;
+      continue;
+    }
+    if((*pte & (PTE_V|PTE_U)) != (PTE_V|PTE_U))
+      continue;
+    if(*pte & PTE_HUGE){
+      va = HUGEPGROUNDDOWN(va) + HUGEPGSIZE - PGSIZE;
+      continue;
+    }
+    if(krefs((void*)PTE2PA(*pte)) != 1)
+      continue;   // shared, e.g. after fork() or program text
+    if(REJECTED(PTE2PA(*pte))){
+      if((*pte & PTE_D) == 0)
+        continue;   // no different from when it was rejected
+      swap.rejected[PAGENO(PTE2PA(*pte)) / 8] &= ~(1 << (PAGENO(PTE2PA(*pte)) % 8));
+    }
+    // p gets a new ASID, so that its TLB entries don't
+    // hide later uses of the page from PTE_A and PTE_D.
+    p->asidgen = 0;
+    if(*pte & PTE_A){
+      *pte &= ~PTE_A;
+      continue;
+    }
+    *pte &= ~PTE_D;
+    pa = PTE2PA(*pte);
+    kshare((void*)pa);   // in case p lets go of it meanwhile
+    break;
+  }
+  end = va >= p->sz;
+  swap.handva = va;
+  release(&p->lock);
+  if(pa == 0)
+    return end ? -1 : 0;
+  swap.handva += PGSIZE;
+
+  if((z = zramput((void*)pa)) >= 0){
+    slot = ZSLOT | z;
+  } else if((slot = slotalloc()) >= 0){
+    virtio_swap_rw((uint64)slot * PGSIZE, (void*)pa, 1);
+  } else {
+    // nowhere to put it, nor, likely, the next page: stop.
+    if(z == ZREJECT)
+      swap.rejected[PAGENO(pa) / 8] |= 1 << (PAGENO(pa) % 8);
+    kfree((void*)pa);
+    *budget = 0;
+    return 0;
+  }
+
+  // make sure p hasn't written, freed or shared the page
+  // while it was being written out.
+  if(!tryacquire(&p->lock))
+    goto undo;
+  if(p->pid != pid || !swappable(p, self) ||
+     (pte = walk(p->pagetable, va, 0)) == 0 ||
+     (*pte & (PTE_V|PTE_D|PTE_HUGE)) != PTE_V ||
+     PTE2PA(*pte) != pa || krefs((void*)pa) != 2){
+    release(&p->lock);
+    goto undo;
+  }
+  *pte = SLOT2PTE(slot) | (PTE_FLAGS(*pte) & ~(PTE_V|PTE_A|PTE_D));
+  p->asidgen = 0;
+  release(&p->lock);
+  kfree((void*)pa);   // the share taken above
+  if(!zramrefill((void*)pa))
+    kfree((void*)pa);   // p's
+  if((slot & ZSLOT) == 0)
+    __atomic_fetch_add(&swap.nout, 1, __ATOMIC_RELAXED);
+  return 1;
+
+ undo:
+  swapfree(slot);
+  kfree((void*)pa);
+  return 0;
+}
+
+// Swap out up to SWAPBATCH pages of processes other than
+// the caller, or of the caller too if self is the calling
+// process and its page table may be changed under it.
+// Returns the number of pages freed.
+int
+swapreclaim(struct proc *self)
+{
+  struct proc *p, *start;
+  uint64 budget = SWAPSCAN;
+  int n = 0, laps = 0, r;
+
+  // this may be kalloc(), called by zramput() from below.
+  push_off();
+  r = holding(&swap.handlock);
+  pop_off();
+  if(r)
+    return 0;
+
+  // holding a spinlock also keeps the proc chunks
+  // from going away under procnext().
+  acquire(&swap.handlock);
+  for(p = procfirst(); p; p = procnext(p))
+    if(p->pid == swap.handpid && p->state != UNUSED)
+      break;
+  if(p == 0){
+    p = procfirst();
+    swap.handva = 0;
+  }
+  start = p;
+  while(p && n < SWAPBATCH && budget > 0){
+    r = swapone(p, self, &budget);
+    if(r > 0){
+      n++;
+      continue;
+    }
+    if(r < 0){
+      // on to the next process. twice round gives
+      // pages that had PTE_A set their second chance.
+      if((p = procnext(p)) == 0)
+        p = procfirst();
+      swap.handva = 0;
+      if(p == start && ++laps == 2)
+        break;
+    }
+  }
+  swap.handpid = p ? p->pid : 0;
+  release(&swap.handlock);
+  return n;
+}
+
+// Swap usage, for kmeminfo().
+void
+swapinfo(struct kmeminfo *mi)
+{
+  acquire(&swap.lock);
+  mi->nswapslots = swap.nslots;
+  mi->nswapused = swap.nused;
+  mi->nswapout = swap.nout;
+  mi->nswapin = swap.nin;
+  mi->swapintime = swap.intime;
+  mi->nzramin = swap.nzin;
+  mi->zramintime = swap.zintime;
+  release(&swap.lock);
+}
@@ -104,6 +104,12 @@ extern uint64 sys_close(void);
 // ============= NEW SYSTEM CALL PROTOTYPE =============
 extern uint64 sys_getprocinfo(void);  // Prototype for new getprocinfo system call
 extern uint64 sys_sleep(void);        // Prototype for sleep system call
+extern uint64 sys_kmeminfo(void);
+extern uint64 sys_slabinfo(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_madvise(void);
+extern uint64 sys_kmemdrain(void);
 // ============= END OF NEW PROTOTYPE =============
 
 // An array mapping syscall numbers from syscall.h
@@ -133,6 +139,12 @@ static uint64 (*syscalls[])(void) = {
 // ============= NEW SYSTEM CALL ENTRY =============
 [SYS_getprocinfo] sys_getprocinfo,     // Add new system call to the table
 [SYS_sleep]   sys_sleep,              // Add sleep system call to the table
+[SYS_kmeminfo] sys_kmeminfo,
+[SYS_slabinfo] sys_slabinfo,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_madvise] sys_madvise,
+[SYS_kmemdrain] sys_kmemdrain,
 // ============= END OF NEW ENTRY =============
 };
 
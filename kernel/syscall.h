@@ -22,3 +22,9 @@
 #define SYS_close  21
 #define SYS_getprocinfo 22
 #define SYS_sleep 23
+#define SYS_kmeminfo 24
+#define SYS_slabinfo 25
+#define SYS_mmap   26
+#define SYS_munmap 27
+#define SYS_madvise 28
+#define SYS_kmemdrain 29
@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "mman.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -503,3 +504,91 @@ sys_pipe(void)
   }
   return 0;
 }
+
+// map len bytes of the file open as fd, from offset off
+// (which must be page-aligned), or of zeroes if flags has
+// MAP_ANONYMOUS. the kernel picks the address; addr is
+// ignored. returns the address, or -1.
+uint64
+sys_mmap(void)
+{
+  uint64 addr;
+  int len, prot, flags, fd, off;
+  struct file *f = 0;
+  struct inode *ip = 0;
+  uint filesz = 0;
+  int perm;
+
+  argaddr(0, &addr);
+  argint(1, &len);
+  argint(2, &prot);
+  argint(3, &flags);
+  argint(5, &off);
+
+  if(len <= 0 || off < 0 || off % PGSIZE != 0)
+    return -1;
+  if((prot & PROT_READ) == 0)
+    return -1;
+  if((flags & (MAP_SHARED|MAP_PRIVATE)) == 0 ||
+     (flags & (MAP_SHARED|MAP_PRIVATE)) == (MAP_SHARED|MAP_PRIVATE))
+    return -1;
+
+  if((flags & MAP_ANONYMOUS) == 0){
+    if(argfd(4, &fd, &f) < 0)
+      return -1;
+    if(f->type != FD_INODE || !f->readable)
+      return -1;
+    if((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+      return -1;
+    ip = f->ip;
+    ilock(ip);
+    if(ip->size > off)
+      filesz = ip->size - off;
+    iunlock(ip);
+    if(filesz > len)
+      filesz = len;
+  }
+
+  perm = PTE_R;
+  if(prot & PROT_WRITE)
+    perm |= PTE_W;
+  if(prot & PROT_EXEC)
+    perm |= PTE_X;
+  return vmamap(myproc(), len, perm, flags & (MAP_SHARED|MAP_PRIVATE),
+                ip, off, filesz);
+}
+
+// unmap the pages from addr to addr+len, which must
+// lie within a single mapping. dirty pages of a
+// MAP_SHARED file mapping are written back.
+uint64
+sys_munmap(void)
+{
+  uint64 addr;
+  int len;
+
+  argaddr(0, &addr);
+  argint(1, &len);
+  if(len <= 0)
+    return -1;
+  return vmaunmap(myproc(), addr, len);
+}
+
+// advise the kernel about the pages from addr to addr+len,
+// heap or mapped: MADV_DONTNEED frees them, and they fault
+// back in as they would have the first time (zero-filled,
+// or read from the file); MADV_WILLNEED faults them all in
+// now. returns 0, or -1 on error.
+uint64
+sys_madvise(void)
+{
+  uint64 addr;
+  int len, advice;
+
+  argaddr(0, &addr);
+  argint(1, &len);
+  argint(2, &advice);
+  if(len <= 0)
+    return -1;
+  return vmaadvise(myproc(), addr, len, advice);
+}
@@ -6,6 +6,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "vm.h"
+#include "kalloc.h"
 
 uint64
 sys_exit(void)
@@ -57,7 +58,7 @@ sys_sbrk(void)
     // memory, vmfault() will allocate it.
     if(addr + n < addr)
       return -1;
-    if(addr + n > TRAPFRAME)
+    if(addr + n > vmaheaptop(myproc()))
       return -1;
     myproc()->sz += n;
   }
@@ -144,3 +145,60 @@ sys_getprocinfo(void)
   
   return getprocinfo(pid, addr);
 }
+
+// copy a kmeminfo report to the user address in
+// argument 0, first draining the allocator's caches
+// if drain is set.
+static uint64
+kmemreport(int drain)
+{
+  uint64 addr;
+  struct kmeminfo mi;
+
+  argaddr(0, &addr);
+  if(drain)
+    kmemdrain(&mi);
+  else
+    kmeminfo(&mi);
+  thpinfo(&mi);
+  swapinfo(&mi);
+  zraminfo(&mi);
+  ksminfo(&mi);
+  oominfo(&mi);
+  if(copyout(myproc()->pagetable, addr, (char *)&mi, sizeof(mi)) < 0)
+    return -1;
+  return 0;
+}
+
+// report free physical memory and its fragmentation.
+uint64
+sys_kmeminfo(void)
+{
+  return kmemreport(0);
+}
+
+// the same, after giving cached free pages back to
+// the buddy allocator so that they can merge.
+uint64
+sys_kmemdrain(void)
+{
+  return kmemreport(1);
+}
+
+// copy usage statistics of up to n slab caches to
+// the array at addr. returns the number copied.
+uint64
+sys_slabinfo(void)
+{
+  uint64 addr;
+  int n, i;
+  struct slabinfo si;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  for(i = 0; i < n && slab_stats(i, &si) == 0; i++){
+    if(copyout(myproc()->pagetable, addr + i*sizeof(si), (char *)&si, sizeof(si)) < 0)
+      return -1;
+  }
+  return i;
+}
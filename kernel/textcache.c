@@ -0,0 +1,206 @@
+// Cache of read-only pages of program files, so that
+// processes running the same binary share its text.
+//
+// vmfault() gets the pages of read-only exec() and mmap()
+// regions from textget(). The cache holds one reference
+// to each page (see kshare()) and every mapping another.
+// Writing to or truncating a file drops its pages from the
+// cache; processes that have them mapped keep their copy.
+// ip->text says whether there may be any to drop, so writes
+// to other files don't take text.lock.
+// Pages only the cache refers to are given up when
+// kalloc() runs out of memory.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "fs.h"
+#include "file.h"
+#include "defs.h"
+
+#define NTEXTHASH 64
+#define TEXTHASH(dev, inum) (((dev) * 31 + (inum)) % NTEXTHASH)
+
+struct textpage {
+  struct textpage *next;  // in hash bucket
+  uint dev;
+  uint inum;
+  uint off;               // file offset of the page
+  uint n;                 // bytes from the file; the rest is zero
+  uint64 pa;
+};
+
+static struct {
+  struct spinlock lock;
+  struct textpage *hash[NTEXTHASH];
+  int n;
+  uint gen;               // bumped by textinval() when it drops pages
+} text;
+
+static struct kmem_cache *textpagecache;
+
+void
+textinit(void)
+{
+  initlock(&text.lock, "text");
+  textpagecache = kmem_cache_create("textpage", sizeof(struct textpage));
+}
+
+// Caller must hold text.lock.
+static struct textpage*
+textlookup(uint dev, uint inum, uint off, uint n)
+{
+  struct textpage *t;
+
+  for(t = text.hash[TEXTHASH(dev, inum)]; t; t = t->next)
+    if(t->dev == dev && t->inum == inum && t->off == off && t->n == n)
+      return t;
+  return 0;
+}
+
+// Return a reference to the physical page holding the
+// page of read-only file region v at va, reading it
+// in if it isn't cached. Returns 0 if out of memory or
+// the read fails.
+uint64
+textget(struct vma *v, uint64 va)
+{
+  struct inode *ip = v->ip;
+  uint64 voff = PGROUNDDOWN(va) - v->start;
+  uint off = v->off + voff;
+  uint n = voff < v->filesz ? v->filesz - voff : 0;
+  struct textpage *t, *nt;
+  char *mem;
+  uint gen;
+
+  if(n > PGSIZE)
+    n = PGSIZE;
+
+  acquire(&text.lock);
+  if((t = textlookup(ip->dev, ip->inum, off, n)) != 0){
+    kshare((void*)t->pa);
+    release(&text.lock);
+    return t->pa;
+  }
+  // set before vmaread() takes ip->lock, so a writer that
+  // finds ip->text clear has finished before the read.
+  __atomic_store_n(&ip->text, 1, __ATOMIC_RELEASE);
+  gen = text.gen;
+  release(&text.lock);
+
+  // not holding text.lock: reading may sleep, and
+  // allocating may call textreclaim().
+  if((mem = kalloc_zeroed()) == 0)
+    return 0;
+  if(vmaread(v, va, mem) < 0 ||
+     (nt = kmem_cache_alloc(textpagecache)) == 0){
+    kfree(mem);
+    return 0;
+  }
+  nt->dev = ip->dev;
+  nt->inum = ip->inum;
+  nt->off = off;
+  nt->n = n;
+  nt->pa = (uint64)mem;
+
+  acquire(&text.lock);
+  if((t = textlookup(ip->dev, ip->inum, off, n)) != 0){
+    // someone else read it in meanwhile.
+    kshare((void*)t->pa);
+    release(&text.lock);
+    kmem_cache_free(textpagecache, nt);
+    kfree(mem);
+    return t->pa;
+  }
+  if(text.gen != gen){
+    // a file changed while we read; the page may be stale
+    // by now, so keep it out of the cache.
+    release(&text.lock);
+    kmem_cache_free(textpagecache, nt);
+    return (uint64)mem;
+  }
+  nt->next = text.hash[TEXTHASH(ip->dev, ip->inum)];
+  text.hash[TEXTHASH(ip->dev, ip->inum)] = nt;
+  text.n++;
+  kshare(mem);   // the cache's reference
+  release(&text.lock);
+  return (uint64)mem;
+}
+
+// Drop ip's pages from the cache, because its
+// contents are about to change. Caller holds ip->lock.
+void
+textinval(struct inode *ip)
+{
+  struct textpage **tp, *t, *dead = 0;
+
+  if(__atomic_load_n(&ip->text, __ATOMIC_ACQUIRE) == 0)
+    return;
+  acquire(&text.lock);
+  // a textget() reading ip now sees gen change, and
+  // doesn't cache its page.
+  __atomic_store_n(&ip->text, 0, __ATOMIC_RELAXED);
+  text.gen++;
+  for(tp = &text.hash[TEXTHASH(ip->dev, ip->inum)]; (t = *tp) != 0; ){
+    if(t->dev == ip->dev && t->inum == ip->inum){
+      *tp = t->next;
+      t->next = dead;
+      dead = t;
+      text.n--;
+    } else {
+      tp = &t->next;
+    }
+  }
+  release(&text.lock);
+
+  while((t = dead) != 0){
+    dead = t->next;
+    kfree((void*)t->pa);
+    kmem_cache_free(textpagecache, t);
+  }
+}
+
+// Give up cached pages that no process has mapped.
+// Called by kalloc() when it runs out of pages; the
+// caller must not hold text.lock.
+// Returns the number of pages freed.
+int
+textreclaim(void)
+{
+  struct textpage **tp, *t, *dead = 0;
+  int n = 0;
+
+  acquire(&text.lock);
+  for(int i = 0; i < NTEXTHASH; i++){
+    for(tp = &text.hash[i]; (t = *tp) != 0; ){
+      if(krefs((void*)t->pa) == 1){
+        *tp = t->next;
+        t->next = dead;
+        dead = t;
+        text.n--;
+      } else {
+        tp = &t->next;
+      }
+    }
+  }
+  release(&text.lock);
+
+  while((t = dead) != 0){
+    dead = t->next;
+    kfree((void*)t->pa);
+    kmem_cache_free(textpagecache, t);
+    n++;
+  }
+  return n;
+}
+
+// Number of pages in the cache.
+int
+textpages(void)
+{
+  return text.n;
+}
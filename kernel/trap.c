@@ -68,9 +68,11 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
-  } else if((r_scause() == 15 || r_scause() == 13) &&
-            vmfault(p->pagetable, r_stval(), (r_scause() == 13)? 1 : 0) != 0) {
+  } else if((r_scause() == 15 || r_scause() == 13 || r_scause() == 12) &&
+            vmfault(p->pagetable, r_stval(), (r_scause() == 15)? 0 : 1) != 0) {
     // page fault on lazily-allocated page
+  } else if((r_scause() == 15 || r_scause() == 13 || r_scause() == 12) && oomwait(p)) {
+    // out of memory, and another process was killed to make room: retry
   } else {
     printf("usertrap(): unexpected scause 0x%lx pid=%d\n", r_scause(), p->pid);
     printf("            sepc=0x%lx stval=0x%lx\n", r_sepc(), r_stval());
@@ -87,7 +89,7 @@ usertrap(void)
   prepare_return();
 
   // the user page table to switch to, for trampoline.S
-  uint64 satp = MAKE_SATP(p->pagetable);
+  uint64 satp = MAKE_SATP(p->pagetable, asidget(p));
 
   // return to trampoline.S; satp value in a0.
   return satp;
@@ -152,8 +154,13 @@ kerneltrap()
   }
 
   // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0)
+  // swapreclaim() leaves the page table of a process preempted
+  // here alone, since it may be in the middle of changing it.
+  if(which_dev == 2 && myproc() != 0){
+    myproc()->kpreempt = 1;
     yield();
+    myproc()->kpreempt = 0;
+  }
 
   // the yield() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
@@ -176,10 +183,9 @@ clockintr()
   mlfq_tick();
   // ============= END OF NEW CODE =============
 
-  // ask for the next timer interrupt. this also clears
-  // the interrupt request. 1000000 is about a tenth
-  // of a second.
-  w_stimecmp(r_time() + 1000000);
+  // ask for the next timer interrupt, 1/TICKHZ of a
+  // second from now. this also clears the interrupt request.
+  w_stimecmp(r_time() + TIMEBASE / TICKHZ);
 }
 
 // check if it's an external interrupt or software interrupt,
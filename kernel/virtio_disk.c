@@ -4,6 +4,10 @@
 //
 // qemu ... -drive file=fs.img,if=none,format=raw,id=x0 -device virtio-blk-device,drive=x0,bus=virtio-mmio-bus.0
 //
+// an optional second disk, on virtio-mmio-bus.1, holds swap space.
+// it raises no interrupts: the driver waits for each transfer by
+// polling, so that pages can be swapped with spinlocks held.
+//
 
 #include "types.h"
 #include "riscv.h"
@@ -16,10 +20,12 @@
 #include "buf.h"
 #include "virtio.h"
 
-// the address of virtio mmio register r.
-#define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
+// the address of virtio mmio register r of disk d.
+#define R(d, r) ((volatile uint32 *)((d)->base + (r)))
+
+struct disk {
+  uint64 base;     // mmio registers
 
-static struct disk {
   // a set (not a ring) of DMA descriptors, with which the
   // driver tells the device where to read and write individual
   // disk operations. there are NUM descriptors.
@@ -56,35 +62,40 @@ static struct disk {
   
   struct spinlock vdisk_lock;
   
-} disk;
+};
 
-void
-virtio_disk_init(void)
+static struct disk disk;      // the file system
+static struct disk swapdisk;  // swap space, if base != 0
+
+// set up the virtio disk at base.
+// returns 0, or -1 if there's no disk there.
+static int
+disk_init(struct disk *d, uint64 base, int intr)
 {
   uint32 status = 0;
 
-  initlock(&disk.vdisk_lock, "virtio_disk");
-
-  if(*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
-     *R(VIRTIO_MMIO_VERSION) != 2 ||
-     *R(VIRTIO_MMIO_DEVICE_ID) != 2 ||
-     *R(VIRTIO_MMIO_VENDOR_ID) != 0x554d4551){
-    panic("could not find virtio disk");
+  d->base = base;
+  if(*R(d, VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
+     *R(d, VIRTIO_MMIO_VERSION) != 2 ||
+     *R(d, VIRTIO_MMIO_DEVICE_ID) != 2 ||
+     *R(d, VIRTIO_MMIO_VENDOR_ID) != 0x554d4551){
+    d->base = 0;
+    return -1;
   }
   
   // reset device
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
 
   // set ACKNOWLEDGE status bit
   status |= VIRTIO_CONFIG_S_ACKNOWLEDGE;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
 
   // set DRIVER status bit
   status |= VIRTIO_CONFIG_S_DRIVER;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
 
   // negotiate features
-  uint64 features = *R(VIRTIO_MMIO_DEVICE_FEATURES);
+  uint64 features = *R(d, VIRTIO_MMIO_DEVICE_FEATURES);
   features &= ~(1 << VIRTIO_BLK_F_RO);
   features &= ~(1 << VIRTIO_BLK_F_SCSI);
   features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
@@ -92,73 +103,98 @@ virtio_disk_init(void)
   features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
   features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
   features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
-  *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+  *R(d, VIRTIO_MMIO_DRIVER_FEATURES) = features;
 
   // tell device that feature negotiation is complete.
   status |= VIRTIO_CONFIG_S_FEATURES_OK;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
 
   // re-read status to ensure FEATURES_OK is set.
-  status = *R(VIRTIO_MMIO_STATUS);
+  status = *R(d, VIRTIO_MMIO_STATUS);
   if(!(status & VIRTIO_CONFIG_S_FEATURES_OK))
     panic("virtio disk FEATURES_OK unset");
 
   // initialize queue 0.
-  *R(VIRTIO_MMIO_QUEUE_SEL) = 0;
+  *R(d, VIRTIO_MMIO_QUEUE_SEL) = 0;
 
   // ensure queue 0 is not in use.
-  if(*R(VIRTIO_MMIO_QUEUE_READY))
+  if(*R(d, VIRTIO_MMIO_QUEUE_READY))
     panic("virtio disk should not be ready");
 
   // check maximum queue size.
-  uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
+  uint32 max = *R(d, VIRTIO_MMIO_QUEUE_NUM_MAX);
   if(max == 0)
     panic("virtio disk has no queue 0");
   if(max < NUM)
     panic("virtio disk max queue too short");
 
   // allocate and zero queue memory.
-  disk.desc = kalloc();
-  disk.avail = kalloc();
-  disk.used = kalloc();
-  if(!disk.desc || !disk.avail || !disk.used)
+  d->desc = kalloc();
+  d->avail = kalloc();
+  d->used = kalloc();
+  if(!d->desc || !d->avail || !d->used)
     panic("virtio disk kalloc");
-  memset(disk.desc, 0, PGSIZE);
-  memset(disk.avail, 0, PGSIZE);
-  memset(disk.used, 0, PGSIZE);
+  memset(d->desc, 0, PGSIZE);
+  memset(d->avail, 0, PGSIZE);
+  memset(d->used, 0, PGSIZE);
 
   // set queue size.
-  *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
+  *R(d, VIRTIO_MMIO_QUEUE_NUM) = NUM;
 
   // write physical addresses.
-  *R(VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint64)disk.desc;
-  *R(VIRTIO_MMIO_QUEUE_DESC_HIGH) = (uint64)disk.desc >> 32;
-  *R(VIRTIO_MMIO_DRIVER_DESC_LOW) = (uint64)disk.avail;
-  *R(VIRTIO_MMIO_DRIVER_DESC_HIGH) = (uint64)disk.avail >> 32;
-  *R(VIRTIO_MMIO_DEVICE_DESC_LOW) = (uint64)disk.used;
-  *R(VIRTIO_MMIO_DEVICE_DESC_HIGH) = (uint64)disk.used >> 32;
+  *R(d, VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint64)d->desc;
+  *R(d, VIRTIO_MMIO_QUEUE_DESC_HIGH) = (uint64)d->desc >> 32;
+  *R(d, VIRTIO_MMIO_DRIVER_DESC_LOW) = (uint64)d->avail;
+  *R(d, VIRTIO_MMIO_DRIVER_DESC_HIGH) = (uint64)d->avail >> 32;
+  *R(d, VIRTIO_MMIO_DEVICE_DESC_LOW) = (uint64)d->used;
+  *R(d, VIRTIO_MMIO_DEVICE_DESC_HIGH) = (uint64)d->used >> 32;
 
   // queue is ready.
-  *R(VIRTIO_MMIO_QUEUE_READY) = 0x1;
+  *R(d, VIRTIO_MMIO_QUEUE_READY) = 0x1;
 
   // all NUM descriptors start out unused.
   for(int i = 0; i < NUM; i++)
-    disk.free[i] = 1;
+    d->free[i] = 1;
+
+  if(!intr)
+    d->avail->flags = VRING_AVAIL_F_NO_INTERRUPT;
 
   // tell device we're completely ready.
   status |= VIRTIO_CONFIG_S_DRIVER_OK;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
+
+  return 0;
+}
+
+void
+virtio_disk_init(void)
+{
+  initlock(&disk.vdisk_lock, "virtio_disk");
+  if(disk_init(&disk, VIRTIO0, 1) < 0)
+    panic("could not find virtio disk");
 
   // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ.
 }
 
+// set up the swap disk, if there is one.
+// returns its size in bytes, or 0.
+uint64
+virtio_swap_init(void)
+{
+  initlock(&swapdisk.vdisk_lock, "virtio_swap");
+  if(disk_init(&swapdisk, VIRTIO1, 0) < 0)
+    return 0;
+  return (*R(&swapdisk, VIRTIO_MMIO_CONFIG) |
+          (uint64)*R(&swapdisk, VIRTIO_MMIO_CONFIG + 4) << 32) * 512;
+}
+
 // find a free descriptor, mark it non-free, return its index.
 static int
-alloc_desc()
+alloc_desc(struct disk *d)
 {
   for(int i = 0; i < NUM; i++){
-    if(disk.free[i]){
-      disk.free[i] = 0;
+    if(d->free[i]){
+      d->free[i] = 0;
       return i;
     }
   }
@@ -167,28 +203,30 @@ alloc_desc()
 
 // mark a descriptor as free.
 static void
-free_desc(int i)
+free_desc(struct disk *d, int i)
 {
   if(i >= NUM)
     panic("free_desc 1");
-  if(disk.free[i])
+  if(d->free[i])
     panic("free_desc 2");
-  disk.desc[i].addr = 0;
-  disk.desc[i].len = 0;
-  disk.desc[i].flags = 0;
-  disk.desc[i].next = 0;
-  disk.free[i] = 1;
-  wakeup(&disk.free[0]);
+  d->desc[i].addr = 0;
+  d->desc[i].len = 0;
+  d->desc[i].flags = 0;
+  d->desc[i].next = 0;
+  d->free[i] = 1;
+  // no one sleeps waiting for the swap disk.
+  if(d == &disk)
+    wakeup(&d->free[0]);
 }
 
 // free a chain of descriptors.
 static void
-free_chain(int i)
+free_chain(struct disk *d, int i)
 {
   while(1){
-    int flag = disk.desc[i].flags;
-    int nxt = disk.desc[i].next;
-    free_desc(i);
+    int flag = d->desc[i].flags;
+    int nxt = d->desc[i].next;
+    free_desc(d, i);
     if(flag & VRING_DESC_F_NEXT)
       i = nxt;
     else
@@ -199,43 +237,33 @@ free_chain(int i)
 // allocate three descriptors (they need not be contiguous).
 // disk transfers always use three descriptors.
 static int
-alloc3_desc(int *idx)
+alloc3_desc(struct disk *d, int *idx)
 {
   for(int i = 0; i < 3; i++){
-    idx[i] = alloc_desc();
+    idx[i] = alloc_desc(d);
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
-        free_desc(idx[j]);
+        free_desc(d, idx[j]);
       return -1;
     }
   }
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// hand the device a request to move len bytes between data
+// and the disk at sector, in the three descriptors idx.
+// caller must hold d->vdisk_lock.
+static void
+disk_submit(struct disk *d, int *idx, uint64 sector, void *data, uint len, int write)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
-
-  acquire(&disk.vdisk_lock);
-
   // the spec's Section 5.2 says that legacy block operations use
   // three descriptors: one for type/reserved/sector, one for the
   // data, one for a 1-byte status result.
 
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
-
   // format the three descriptors.
   // qemu's virtio-blk.c reads them.
 
-  struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
+  struct virtio_blk_req *buf0 = &d->ops[idx[0]];
 
   if(write)
     buf0->type = VIRTIO_BLK_T_OUT; // write the disk
@@ -244,41 +272,60 @@ virtio_disk_rw(struct buf *b, int write)
   buf0->reserved = 0;
   buf0->sector = sector;
 
-  disk.desc[idx[0]].addr = (uint64) buf0;
-  disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
-  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
+  d->desc[idx[0]].addr = (uint64) buf0;
+  d->desc[idx[0]].len = sizeof(struct virtio_blk_req);
+  d->desc[idx[0]].flags = VRING_DESC_F_NEXT;
+  d->desc[idx[0]].next = idx[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
+  d->desc[idx[1]].addr = (uint64) data;
+  d->desc[idx[1]].len = len;
   if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
+    d->desc[idx[1]].flags = 0; // device reads data
   else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+    d->desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes data
+  d->desc[idx[1]].flags |= VRING_DESC_F_NEXT;
+  d->desc[idx[1]].next = idx[2];
 
-  disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
-
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  d->info[idx[0]].status = 0xff; // device writes 0 on success
+  d->desc[idx[2]].addr = (uint64) &d->info[idx[0]].status;
+  d->desc[idx[2]].len = 1;
+  d->desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
+  d->desc[idx[2]].next = 0;
 
   // tell the device the first index in our chain of descriptors.
-  disk.avail->ring[disk.avail->idx % NUM] = idx[0];
+  d->avail->ring[d->avail->idx % NUM] = idx[0];
 
   __sync_synchronize();
 
   // tell the device another avail ring entry is available.
-  disk.avail->idx += 1; // not % NUM ...
+  d->avail->idx += 1; // not % NUM ...
 
   __sync_synchronize();
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  *R(d, VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+}
+
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  uint64 sector = b->blockno * (BSIZE / 512);
+
+  acquire(&disk.vdisk_lock);
+
+  // allocate the three descriptors.
+  int idx[3];
+  while(1){
+    if(alloc3_desc(&disk, idx) == 0) {
+      break;
+    }
+    sleep(&disk.free[0], &disk.vdisk_lock);
+  }
+
+  // record struct buf for virtio_disk_intr().
+  b->disk = 1;
+  disk.info[idx[0]].b = b;
+
+  disk_submit(&disk, idx, sector, b->data, BSIZE, write);
 
   // Wait for virtio_disk_intr() to say request has finished.
   while(b->disk == 1) {
@@ -286,11 +333,41 @@ virtio_disk_rw(struct buf *b, int write)
   }
 
   disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+  free_chain(&disk, idx[0]);
 
   release(&disk.vdisk_lock);
 }
 
+// move a page between pa and the swap disk at byte offset off,
+// waiting for the transfer by polling. never sleeps, so may be
+// called with spinlocks held.
+void
+virtio_swap_rw(uint64 off, void *pa, int write)
+{
+  struct disk *d = &swapdisk;
+  int idx[3];
+
+  if(d->base == 0)
+    panic("virtio_swap_rw: no swap disk");
+
+  acquire(&d->vdisk_lock);
+
+  // only one request is ever outstanding.
+  if(alloc3_desc(d, idx) < 0)
+    panic("virtio_swap_rw: desc");
+  disk_submit(d, idx, off / 512, pa, PGSIZE, write);
+
+  while(*(volatile uint16 *)&d->used->idx == d->used_idx)
+    ;
+  __sync_synchronize();
+  d->used_idx += 1;
+  if(d->info[idx[0]].status != 0)
+    panic("virtio_swap_rw status");
+
+  free_chain(d, idx[0]);
+  release(&d->vdisk_lock);
+}
+
 void
 virtio_disk_intr()
 {
@@ -302,7 +379,7 @@ virtio_disk_intr()
   // the "used" ring, in which case we may process the new
   // completion entries in this interrupt, and have nothing to do
   // in the next interrupt, which is harmless.
-  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+  *R(&disk, VIRTIO_MMIO_INTERRUPT_ACK) = *R(&disk, VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
 
   __sync_synchronize();
 
@@ -7,6 +7,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "fs.h"
+#include "kalloc.h"
 
 /*
  * the kernel's page table.
@@ -17,6 +18,31 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+static pte_t *walklevel(pagetable_t, uint64, int, int);
+static uint64 fault(struct proc*, pagetable_t, uint64, int, int);
+
+// transparent huge pages: big enough anonymous parts of the
+// heap are backed by 2 MiB pages (PTE_HUGE) when there is
+// contiguous memory. anything that needs a 4 KiB page of one,
+// like fork() or unmapping part of it, splits it first.
+#define HUGEORDER (PXSHIFT(1) - PGSHIFT)
+
+// a huge page in a sparsely touched heap wastes most of its
+// 2 MiB, so leave the last quarter of RAM to 4 KiB pages.
+#define THPMINFREE ((PHYSTOP - KERNBASE) / PGSIZE / 4)
+
+struct {
+  uint64 nfault;     // huge pages mapped
+  uint64 nfallback;  // times no contiguous memory was free
+  uint64 nsplit;     // huge pages split into 4 KiB pages
+} thp;
+
+// read faults on untouched heap pages map this one page of
+// zeros, copy-on-write, rather than allocating pages until
+// something is written to them.
+static uint64 zeropage;
+static uint64 nzerofault;
+
 // Make a direct-map page table for the kernel.
 pagetable_t
 kvmmake(void)
@@ -32,6 +58,9 @@ kvmmake(void)
   // virtio mmio disk interface
   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
+  // and the swap disk's
+  kvmmap(kpgtbl, VIRTIO1, VIRTIO1, PGSIZE, PTE_R | PTE_W);
+
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x4000000, PTE_R | PTE_W);
 
@@ -39,15 +68,14 @@ kvmmake(void)
   kvmmap(kpgtbl, KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
   // map kernel data and the physical RAM we'll make use of.
+  // mappages() uses 2 MiB pages from the first 2 MiB boundary
+  // past etext, so most of RAM takes a few dozen PTEs.
   kvmmap(kpgtbl, (uint64)etext, (uint64)etext, PHYSTOP-(uint64)etext, PTE_R | PTE_W);
 
   // map the trampoline for trap entry/exit to
   // the highest virtual address in the kernel.
   kvmmap(kpgtbl, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 
-  // allocate and map a kernel stack for each process.
-  proc_mapstacks(kpgtbl);
-  
   return kpgtbl;
 }
 
@@ -61,11 +89,79 @@ kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
     panic("kvmmap");
 }
 
+// kernel stacks come from kalloc(), but are used through
+// a slot of their own in the kernel page table rather than
+// through the direct map, so that overflowing one faults on
+// the unmapped guard page below it. page-table pages for the
+// slots are allocated as slots are first used, and kept.
+// a freed slot's page may still be in other harts' TLBs, so
+// scheduler() flushes a stack's page before switching to it.
+static struct {
+  struct spinlock lock;
+  uint64 used[NKSTACK/64];  // bitmap of slots in use
+  int hint;                 // no free slot in used[] below this
+} kstacks;
+
+// Allocate a kernel stack page and map it in a free slot.
+// Returns its virtual address, or 0 if out of memory or slots.
+uint64
+kstackalloc(void)
+{
+  char *pa;
+  uint64 va = 0;
+  int i, b;
+
+  if((pa = kalloc()) == 0)
+    return 0;
+  acquire(&kstacks.lock);
+  for(i = kstacks.hint; i < NKSTACK/64 && kstacks.used[i] == ~0UL; i++)
+    ;
+  kstacks.hint = i;
+  if(i < NKSTACK/64){
+    for(b = 0; kstacks.used[i] & (1UL << b); b++)
+      ;
+    va = KSTACK(i*64 + b);
+    if(mappages(kernel_pagetable, va, PGSIZE, (uint64)pa, PTE_R | PTE_W) == 0)
+      kstacks.used[i] |= 1UL << b;
+    else
+      va = 0;
+  }
+  release(&kstacks.lock);
+  if(va == 0)
+    kfree(pa);
+  return va;
+}
+
+// Unmap and free the kernel stack at va, from kstackalloc().
+void
+kstackfree(uint64 va)
+{
+  int slot = (TRAMPOLINE - va) / (2*PGSIZE) - 1;
+  pte_t *pte;
+  uint64 pa;
+
+  acquire(&kstacks.lock);
+  if((pte = walk(kernel_pagetable, va, 0)) == 0 || (*pte & PTE_V) == 0)
+    panic("kstackfree");
+  pa = PTE2PA(*pte);
+  *pte = 0;
+  kstacks.used[slot/64] &= ~(1UL << (slot%64));
+  if(slot/64 < kstacks.hint)
+    kstacks.hint = slot/64;
+  release(&kstacks.lock);
+  kfree((void*)pa);
+}
+
 // Initialize the kernel_pagetable, shared by all CPUs.
 void
 kvminit(void)
 {
+  initlock(&kstacks.lock, "kstacks");
   kernel_pagetable = kvmmake();
+
+  if((zeropage = (uint64) kalloc()) == 0)
+    panic("kvminit: zero page");
+  memset((void*)zeropage, 0, PGSIZE);
 }
 
 // Switch the current CPU's h/w page table register to
@@ -76,7 +172,7 @@ kvminithart()
   // wait for any previous writes to the page table memory to finish.
   sfence_vma();
 
-  w_satp(MAKE_SATP(kernel_pagetable));
+  w_satp(MAKE_SATP(kernel_pagetable, 0));
 
   // flush stale entries from the TLB.
   sfence_vma();
@@ -94,24 +190,40 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+//
+// A valid PTE with any of R, W or X set at level 2 or 1 is
+// a leaf for a 1 GiB or 2 MiB page; if va lies in such a
+// page, walk() returns that PTE.
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
+{
+  return walklevel(pagetable, va, 0, alloc);
+}
+
+// Like walk(), but return the PTE for va at the given level,
+// for mapping a page of size 1 << PXSHIFT(level).
+static pte_t *
+walklevel(pagetable_t pagetable, uint64 va, int level, int alloc)
 {
   if(va >= MAXVA)
     panic("walk");
 
-  for(int level = 2; level > 0; level--) {
-    pte_t *pte = &pagetable[PX(level, va)];
+  for(int l = 2; l > level; l--) {
+    pte_t *pte = &pagetable[PX(l, va)];
     if(*pte & PTE_V) {
+      if(*pte & (PTE_R|PTE_W|PTE_X))
+        return pte;   // va is in a superpage
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = (pde_t*)kalloc_zeroed()) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
+      // uvmusage() on another hart must not see the PTE
+      // before the zeroed page it points to.
+      __sync_synchronize();
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
-  return &pagetable[PX(0, va)];
+  return &pagetable[PX(level, va)];
 }
 
 // Look up a virtual address, return the physical address,
@@ -134,19 +246,25 @@ walkaddr(pagetable_t pagetable, uint64 va)
   if((*pte & PTE_U) == 0)
     return 0;
   pa = PTE2PA(*pte);
+  if(*pte & PTE_HUGE)
+    pa += PGROUNDDOWN(va) & (HUGEPGSIZE - 1);
   return pa;
 }
 
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa.
 // va and size MUST be page-aligned.
+// Where va, pa and the remaining size allow, maps 1 GiB or
+// 2 MiB pages with a single PTE; build with KVM_4K defined
+// (make KVM_4K=1) to always use 4 KiB pages, for comparison.
 // Returns 0 on success, -1 if walk() couldn't
 // allocate a needed page-table page.
 int
 mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 {
-  uint64 a, last;
+  uint64 a, end, sz;
   pte_t *pte;
+  int level;
 
   if((va % PGSIZE) != 0)
     panic("mappages: va not aligned");
@@ -158,17 +276,24 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
     panic("mappages: size");
   
   a = va;
-  last = va + size - PGSIZE;
-  for(;;){
-    if((pte = walk(pagetable, a, 1)) == 0)
+  end = va + size;
+  while(a < end){
+    // the largest page that fits.
+    for(level = 2; level > 0; level--){
+      sz = 1L << PXSHIFT(level);
+#ifndef KVM_4K
+      if(a % sz == 0 && pa % sz == 0 && end - a >= sz)
+        break;
+#endif
+    }
+    sz = 1L << PXSHIFT(level);
+    if((pte = walklevel(pagetable, a, level, 1)) == 0)
       return -1;
     if(*pte & PTE_V)
       panic("mappages: remap");
     *pte = PA2PTE(pa) | perm | PTE_V;
-    if(a == last)
-      break;
-    a += PGSIZE;
-    pa += PGSIZE;
+    a += sz;
+    pa += sz;
   }
   return 0;
 }
@@ -179,36 +304,114 @@ pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kalloc_zeroed();
   if(pagetable == 0)
     return 0;
-  memset(pagetable, 0, PGSIZE);
   return pagetable;
 }
 
+// Map a zeroed 2 MiB page at base, which must be aligned,
+// if nothing is mapped between base and base+HUGEPGSIZE yet
+// and there is a free 2 MiB block.
+// returns its physical address, or 0.
+static uint64
+uvmhuge(pagetable_t pagetable, uint64 base, int perm)
+{
+  pte_t *pte;
+  char *mem;
+  struct kmeminfo mi;
+
+  if((pte = walklevel(pagetable, base, 1, 1)) == 0)
+    return 0;
+  if(*pte & PTE_V)
+    return 0;   // a page table for 4 KiB pages, or a huge page
+  kmeminfo(&mi);
+  if(mi.nfree < THPMINFREE + (1 << HUGEORDER) ||
+     (mem = kalloc_order(HUGEORDER)) == 0){
+    __atomic_fetch_add(&thp.nfallback, 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  memset(mem, 0, HUGEPGSIZE);
+  *pte = PA2PTE(mem) | perm | PTE_V | PTE_HUGE;
+  __atomic_fetch_add(&thp.nfault, 1, __ATOMIC_RELAXED);
+  return (uint64)mem;
+}
+
+// Replace the huge page leaf *pte with a page-table page of
+// 4 KiB PTEs for the same memory. If tbl is not 0, it must be
+// one of the huge page's own pages that the caller is about
+// to unmap, and becomes the page-table page, so that
+// splitting needn't allocate.
+// returns 0, or -1 if out of memory.
+static int
+uvmsplit(pte_t *pte, uint64 tbl)
+{
+  uint64 pa = PTE2PA(*pte);
+  uint flags = PTE_FLAGS(*pte) & ~PTE_HUGE;
+  pagetable_t pt;
+
+  if(tbl == 0 && (tbl = (uint64)kalloc()) == 0)
+    return -1;
+  pt = (pagetable_t)tbl;
+  for(int i = 0; i < 512; i++){
+    uint64 a = pa + i*PGSIZE;
+    pt[i] = a == tbl ? 0 : PA2PTE(a) | flags;
+  }
+  __sync_synchronize();   // fill pt before publishing it; see walklevel()
+  *pte = PA2PTE(tbl) | PTE_V;
+  __atomic_fetch_add(&thp.nsplit, 1, __ATOMIC_RELAXED);
+  return 0;
+}
+
 // Remove npages of mappings starting from va. va must be
 // page-aligned. It's OK if the mappings don't exist.
 // Optionally free the physical memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
-  uint64 a;
+  uint64 a, end = va + npages*PGSIZE;
   pte_t *pte;
+  int unmapped = 0;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
-  for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
+  for(a = va; a < end; a += PGSIZE){
     if((pte = walk(pagetable, a, 0)) == 0) // leaf page table entry allocated?
       continue;   
-    if((*pte & PTE_V) == 0)  // has physical page been allocated?
+    if((*pte & PTE_V) == 0){  // has physical page been allocated?
+      if(PTE_SWAPPED(*pte)){
+        swapfree(PTE2SLOT(*pte));
+        *pte = 0;
+      }
       continue;
+    }
+    unmapped = 1;
+    if(*pte & PTE_HUGE){
+      if(a % HUGEPGSIZE == 0 && end - a >= HUGEPGSIZE){
+        if(do_free)
+          kfree_order((void*)PTE2PA(*pte), HUGEORDER);
+        *pte = 0;
+        a += HUGEPGSIZE - PGSIZE;
+        continue;
+      }
+      // unmapping part of it: the page at a can hold
+      // the page table, if it's being freed anyway.
+      uint64 pa = PTE2PA(*pte) + (a & (HUGEPGSIZE - 1));
+      if(uvmsplit(pte, do_free ? pa : 0) < 0)
+        panic("uvmunmap: split");
+      if(do_free)
+        continue;
+      pte = walk(pagetable, a, 0);
+    }
     if(do_free){
       uint64 pa = PTE2PA(*pte);
       kfree((void*)pa);
     }
     *pte = 0;
   }
+  if(unmapped)
+    tlbflush(pagetable);
 }
 
 // Allocate PTEs and physical memory to grow a process from oldsz to
@@ -224,18 +427,23 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    if(a % HUGEPGSIZE == 0 && newsz - a >= HUGEPGSIZE &&
+       uvmhuge(pagetable, a, PTE_R|PTE_U|xperm) != 0){
+      a += HUGEPGSIZE - PGSIZE;
+      continue;
+    }
+    mem = kalloc_zeroed();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_R|PTE_U|xperm) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
   }
+  tlbflush(pagetable);
   return newsz;
 }
 
@@ -287,39 +495,92 @@ uvmfree(pagetable_t pagetable, uint64 sz)
   freewalk(pagetable);
 }
 
+// Add up the user pages mapped in pagetable (but for the
+// zero page), in *rss, those swapped out, in *nswapped, and
+// the page-table pages, in *npt. A huge page counts as the
+// 4 KiB pages it holds. Caller holds the process's lock, so
+// that exec() can't free the page table underneath.
+void
+uvmusage(pagetable_t pagetable, uint64 *rss, uint64 *nswapped, uint64 *npt)
+{
+  (*npt)++;
+  for(int i = 0; i < 512; i++){
+    pte_t pte = pagetable[i];
+    if((pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0){
+      uvmusage((pagetable_t)PTE2PA(pte), rss, nswapped, npt);
+    } else if((pte & (PTE_V|PTE_U)) == (PTE_V|PTE_U)){
+      if(PTE2PA(pte) != zeropage)
+        *rss += (pte & PTE_HUGE) ? HUGEPGSIZE / PGSIZE : 1;
+    } else if(PTE_SWAPPED(pte)){
+      (*nswapped)++;
+    }
+  }
+}
+
 // Given a parent process's page table, copy
 // its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Copies only the page table: the physical
+// pages are shared, and writable ones become
+// read-only and copy-on-write in both tables.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 {
-  pte_t *pte;
+  return uvmshare(old, new, 0, sz, 1);
+}
+
+// Map the pages of old between page-aligned start
+// and end into new as well. If cow is set, writable
+// pages become copy-on-write in both tables; if not,
+// writes through either table are seen by both.
+// returns 0 on success, -1 on failure.
+// unmaps any pages it mapped on failure.
+int
+uvmshare(pagetable_t old, pagetable_t new, uint64 start, uint64 end, int cow)
+{
+  pte_t *pte, *npte;
   uint64 pa, i;
   uint flags;
-  char *mem;
+  int changed = 0;
 
-  for(i = 0; i < sz; i += PGSIZE){
+  for(i = start; i < end; i += PGSIZE){
     if((pte = walk(old, i, 0)) == 0)
       continue;   // page table entry hasn't been allocated
+    if(PTE_SWAPPED(*pte)){
+      // both share the slot, and each reads in a copy of its own.
+      if((npte = walk(new, i, 1)) == 0)
+        goto err;
+      swapdup(PTE2SLOT(*pte));
+      *npte = *pte;
+      continue;
+    }
     if((*pte & PTE_V) == 0)
       continue;   // physical page hasn't been allocated
+    if(*pte & PTE_HUGE){
+      // pages are shared and copied 4 KiB at a time.
+      if(uvmsplit(pte, 0) < 0)
+        goto err;
+      pte = walk(old, i, 0);
+    }
+    if(cow && (*pte & PTE_W)){
+      *pte = (*pte & ~PTE_W) | PTE_COW;
+      changed = 1;
+    }
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
+    if(mappages(new, i, PGSIZE, pa, flags) != 0)
       goto err;
-    }
+    kshare((void*)pa);
   }
+  if(changed)
+    tlbflush(old);
   return 0;
 
  err:
-  uvmunmap(new, 0, i / PGSIZE, 1);
+  if(changed)
+    tlbflush(old);
+  uvmunmap(new, start, (i - start) / PGSIZE, 1);
   return -1;
 }
 
@@ -336,40 +597,113 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// Give the copy-on-write user page at va a writable
+// physical page of its own, copying the shared one
+// unless no one else refers to it any more.
+// returns the physical address, or 0 if va isn't a
+// copy-on-write page or out of memory.
+static uint64
+uvmcow(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  char *mem;
+
+  if((pte = walk(pagetable, va, 0)) == 0)
+    return 0;
+  if((*pte & (PTE_V|PTE_U|PTE_COW)) != (PTE_V|PTE_U|PTE_COW))
+    return 0;
+  pa = PTE2PA(*pte);
+  if(krefs((void*)pa) > 1){
+    if(pa == zeropage)
+      mem = kalloc_zeroed();
+    else if((mem = kalloc()) != 0)
+      memmove(mem, (char*)pa, PGSIZE);
+    if(mem == 0)
+      return 0;
+    *pte = PA2PTE(mem) | PTE_FLAGS(*pte);
+    kfree((void*)pa);
+    pa = (uint64)mem;
+  }
+  *pte = (*pte & ~PTE_COW) | PTE_W;
+  tlbflushpage(pagetable, va);
+  return pa;
+}
+
+// Find the kernel address of user address va for copyin()
+// and friends, faulting the page in if need be; if write is
+// set, break copy-on-write and mark the page dirty.
+// *ptep is the PTE of the page just before va, or 0: within
+// a page-table page the next PTE is found without walking
+// the page table again. Sets *ptep to va's PTE, and *n to
+// the number of bytes from va to the end of its page (or
+// huge page). Returns 0 if va isn't accessible.
+static char*
+uvmaccess(pagetable_t pagetable, uint64 va, int write, pte_t **ptep, uint64 *n)
+{
+  pte_t *pte = *ptep;
+  uint64 size, pa;
+
+  if(va >= MAXVA)
+    return 0;
+  if(pte == 0 || (va & (HUGEPGSIZE - 1)) == 0)
+    pte = walk(pagetable, va, 0);
+  else
+    pte++;
+  if(pte == 0 || (*pte & PTE_V) == 0){
+    // faulting may read a file or the swap disk and sleep,
+    // so callers must not hold spinlocks; copy through a
+    // buffer instead, as piperead() does.
+    if(!intr_get())
+      panic("uvmaccess: fault with interrupts off");
+    if(myproc()->nofault){
+      myproc()->nofault = 2;   // tell the caller why
+      return 0;
+    }
+    if(vmfault(pagetable, va, !write) == 0)
+      return 0;
+    pte = walk(pagetable, va, 0);
+  }
+  if((*pte & PTE_U) == 0)
+    return 0;
+  if(write){
+    if(*pte & PTE_COW){
+      if(uvmcow(pagetable, PGROUNDDOWN(va)) == 0)
+        return 0;
+    } else if((*pte & PTE_W) == 0){
+      // forbid copyout over read-only user text pages.
+      return 0;
+    }
+    *pte |= PTE_D;  // for write-back of shared mappings
+  }
+
+  size = (*pte & PTE_HUGE) ? HUGEPGSIZE : PGSIZE;
+  pa = PTE2PA(*pte) + (va & (size - 1));
+  *n = size - (va & (size - 1));
+  *ptep = pte;
+  return (char*)pa;
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
 int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
-  uint64 n, va0, pa0;
-  pte_t *pte;
+  pte_t *pte = 0;
+  uint64 n;
+  char *dst;
 
   while(len > 0){
-    va0 = PGROUNDDOWN(dstva);
-    if(va0 >= MAXVA)
-      return -1;
-  
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0) {
-      if((pa0 = vmfault(pagetable, va0, 0)) == 0) {
-        return -1;
-      }
-    }
-
-    pte = walk(pagetable, va0, 0);
-    // forbid copyout over read-only user text pages.
-    if((*pte & PTE_W) == 0)
+    if((dst = uvmaccess(pagetable, dstva, 1, &pte, &n)) == 0)
       return -1;
-      
-    n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
-    memmove((void *)(pa0 + (dstva - va0)), src, n);
+    memmove(dst, src, n);
 
     len -= n;
     src += n;
-    dstva = va0 + PGSIZE;
+    dstva += n;
   }
   return 0;
 }
@@ -380,28 +714,47 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 int
 copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
-  uint64 n, va0, pa0;
+  pte_t *pte = 0;
+  uint64 n;
+  char *src;
 
   while(len > 0){
-    va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0) {
-      if((pa0 = vmfault(pagetable, va0, 0)) == 0) {
-        return -1;
-      }
-    }
-    n = PGSIZE - (srcva - va0);
+    if((src = uvmaccess(pagetable, srcva, 0, &pte, &n)) == 0)
+      return -1;
     if(n > len)
       n = len;
-    memmove(dst, (void *)(pa0 + (srcva - va0)), n);
+    memmove(dst, src, n);
 
     len -= n;
     dst += n;
-    srcva = va0 + PGSIZE;
+    srcva += n;
   }
   return 0;
 }
 
+// Length of the string at s, or n if none of its first
+// n bytes is a '\0'. Looks at a word at a time where it
+// can; s+n must not be beyond the end of s's page.
+static uint64
+strnlen_page(char *s, uint64 n)
+{
+  uint64 i = 0, w;
+
+  for(; i < n && ((uint64)(s + i) & 7) != 0; i++)
+    if(s[i] == '\0')
+      return i;
+  // stop at the first word with a zero byte in it.
+  for(; i + 8 <= n; i += 8){
+    w = *(uint64*)(s + i);
+    if(((w - 0x0101010101010101UL) & ~w & 0x8080808080808080UL) != 0)
+      break;
+  }
+  for(; i < n; i++)
+    if(s[i] == '\0')
+      return i;
+  return n;
+}
+
 // Copy a null-terminated string from user to kernel.
 // Copy bytes to dst from virtual address srcva in a given page table,
 // until a '\0', or max.
@@ -409,66 +762,142 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 int
 copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 {
-  uint64 n, va0, pa0;
-  int got_null = 0;
+  pte_t *pte = 0;
+  uint64 n, len;
+  char *src;
 
-  while(got_null == 0 && max > 0){
-    va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+  while(max > 0){
+    if((src = uvmaccess(pagetable, srcva, 0, &pte, &n)) == 0)
       return -1;
-    n = PGSIZE - (srcva - va0);
     if(n > max)
       n = max;
-
-    char *p = (char *) (pa0 + (srcva - va0));
-    while(n > 0){
-      if(*p == '\0'){
-        *dst = '\0';
-        got_null = 1;
-        break;
-      } else {
-        *dst = *p;
-      }
-      --n;
-      --max;
-      p++;
-      dst++;
+    len = strnlen_page(src, n);
+    memmove(dst, src, len);
+    if(len < n){
+      dst[len] = '\0';
+      return 0;
     }
 
-    srcva = va0 + PGSIZE;
-  }
-  if(got_null){
-    return 0;
-  } else {
-    return -1;
+    max -= n;
+    dst += n;
+    srcva += n;
   }
+  return -1;
 }
 
 // allocate and map user memory if process is referencing a page
-// that was lazily allocated in sys_sbrk().
+// that was lazily allocated in sys_sbrk(), or one of a region
+// set up by exec() or mmap(), or read back in a page that was
+// swapped out, or give it its own copy of a copy-on-write page
+// it is writing to.
 // returns 0 if va is invalid or already mapped, or if
 // out of physical memory, and physical address if successful.
+// out of memory, it calls oomkill(), which may ask the
+// process to wait and try again; see oomwait().
 uint64
 vmfault(pagetable_t pagetable, uint64 va, int read)
 {
-  uint64 mem;
   struct proc *p = myproc();
+  uint64 mem;
+
+  p->oomwait = 0;
+  if((mem = fault(p, pagetable, va, read, 1)) != 0)
+    p->nfault++;
+  return mem;
+}
+
+// Like vmfault(), but for madvise(MADV_WILLNEED): only a hint,
+// so out of memory it just fails, and kills no one.
+uint64
+vmprefault(pagetable_t pagetable, uint64 va, int read)
+{
+  return fault(myproc(), pagetable, va, read, 0);
+}
+
+static uint64
+fault(struct proc *p, pagetable_t pagetable, uint64 va, int read, int oom)
+{
+  uint64 mem;
+  struct vma *v;
+  pte_t *pte;
+  int perm = PTE_W|PTE_U|PTE_R;
+
+  // p->sz and p->vmas describe p->pagetable only; exec()'s
+  // copyout()s to the new page table must not fault.
+  if(pagetable != p->pagetable)
+    panic("fault: not the process's page table");
 
-  if (va >= p->sz)
-    return 0;
   va = PGROUNDDOWN(va);
-  if(ismapped(pagetable, va)) {
+  v = vmalookup(p, va);
+  if (va >= p->sz && v == 0)
     return 0;
+  if((pte = walk(pagetable, va, 0)) != 0 && PTE_SWAPPED(*pte)){
+    // kalloc() won't swap out the faulting process's own
+    // pages, since it is running, but it's safe to here.
+    if((mem = swapin(pagetable, va)) == 0 && swapreclaim(p) > 0)
+      mem = swapin(pagetable, va);
+    if(mem == 0 && oom)
+      oomkill(p);
+    else if(mem != 0)
+      p->nmajfault++;
+    return mem;
+  }
+  if(ismapped(pagetable, va)) {
+    if(read)
+      return 0;
+    if((mem = uvmcow(pagetable, va)) == 0 && (*pte & PTE_COW) && oom)
+      oomkill(p);
+    return mem;
+  }
+  if(v != 0 && v->ip && (v->perm & PTE_W) == 0){
+    // read-only file pages are shared with other processes.
+    if((mem = textget(v, va)) == 0)
+      return 0;
+    if(mappages(pagetable, va, PGSIZE, mem, PTE_U|v->perm) != 0){
+      kfree((void *)mem);
+      return 0;
+    }
+    tlbflushpage(pagetable, va);
+    return mem;
+  }
+  if(v == 0 && read){
+    if(mappages(pagetable, va, PGSIZE, zeropage, PTE_R|PTE_U|PTE_COW) != 0)
+      return 0;
+    kshare((void*)zeropage);
+    tlbflushpage(pagetable, va);
+    __atomic_fetch_add(&nzerofault, 1, __ATOMIC_RELAXED);
+    return zeropage;
   }
-  mem = (uint64) kalloc();
-  if(mem == 0)
+  if(v == 0){
+    // try for a huge page, if its 2 MiB are all heap.
+    uint64 base = HUGEPGROUNDDOWN(va);
+    if(base + HUGEPGSIZE <= p->sz && !vmaoverlaps(p, base, base + HUGEPGSIZE) &&
+       (mem = uvmhuge(pagetable, base, PTE_W|PTE_U|PTE_R)) != 0){
+      tlbflush(pagetable);
+      return mem + (va - base);
+    }
+  }
+  mem = (uint64) kalloc_zeroed();
+  if(mem == 0 && swapreclaim(p) > 0)
+    mem = (uint64) kalloc_zeroed();
+  if(mem == 0){
+    if(oom)
+      oomkill(p);
     return 0;
-  memset((void *) mem, 0, PGSIZE);
-  if (mappages(p->pagetable, va, PGSIZE, mem, PTE_W|PTE_U|PTE_R) != 0) {
+  }
+  if(v != 0){
+    if(v->ip && vmaread(v, va, (char*)mem) < 0){
+      kfree((void *)mem);
+      return 0;
+    }
+    perm = PTE_U|v->perm;
+  }
+  if (mappages(pagetable, va, PGSIZE, mem, perm) != 0) {
     kfree((void *)mem);
     return 0;
   }
+  // the hart may have cached the invalid PTE.
+  tlbflushpage(pagetable, va);
   return mem;
 }
 
@@ -484,3 +913,13 @@ ismapped(pagetable_t pagetable, uint64 va)
   }
   return 0;
 }
+
+// Add the transparent huge page and zero page counters to mi.
+void
+thpinfo(struct kmeminfo *mi)
+{
+  mi->nthpfault = thp.nfault;
+  mi->nthpfallback = thp.nfallback;
+  mi->nthpsplit = thp.nsplit;
+  mi->nzerofault = nzerofault;
+}
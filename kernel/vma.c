@@ -0,0 +1,358 @@
+// Regions of a process's address space that are mapped
+// lazily: the ELF segments that exec() maps, and regions
+// made by mmap(). Their pages are read in (or zero-filled)
+// by vmfault() on first touch.
+//
+// exec() segments lie below p->sz, so the rest of the VM
+// code copies and frees their pages along with the heap.
+// mmap() regions lie above the heap, below MMAPTOP, and
+// are looked after here.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "fs.h"
+#include "file.h"
+#include "mman.h"
+#include "defs.h"
+
+static int
+vmaused(struct vma *v)
+{
+  return v->start != v->end;
+}
+
+// Find p's region that contains va.
+struct vma*
+vmalookup(struct proc *p, uint64 va)
+{
+  struct vma *v;
+
+  for(v = p->vmas; v < &p->vmas[NVMA]; v++)
+    if(va >= v->start && va < v->end)
+      return v;
+  return 0;
+}
+
+// Does any of p's regions overlap start..end?
+int
+vmaoverlaps(struct proc *p, uint64 start, uint64 end)
+{
+  struct vma *v;
+
+  for(v = p->vmas; v < &p->vmas[NVMA]; v++)
+    if(vmaused(v) && v->start < end && start < v->end)
+      return 1;
+  return 0;
+}
+
+// Read the page of region v at va into mem, which must
+// be zeroed; the part of the region past filesz stays zero.
+// Returns 0 on success, -1 on error.
+int
+vmaread(struct vma *v, uint64 va, char *mem)
+{
+  uint64 off = PGROUNDDOWN(va) - v->start;
+  uint n;
+  int r;
+
+  if(off >= v->filesz)
+    return 0;
+  n = v->filesz - off;
+  if(n > PGSIZE)
+    n = PGSIZE;
+
+  // no inode or buffer locks are held here: fileread() and
+  // filewrite() copy to and from user memory without them.
+  ilock(v->ip);
+  r = readi(v->ip, 0, (uint64)mem, v->off + off, n);
+  iunlock(v->ip);
+  return r == n ? 0 : -1;
+}
+
+// Write the page of shared file region v at va, which
+// is mapped to pa, back to the file, in a transaction
+// of its own. Never extends the file.
+static void
+vmawrite(struct vma *v, uint64 va, uint64 pa)
+{
+  uint64 off = va - v->start;
+  uint n;
+
+  if(off >= v->filesz)
+    return;
+  n = v->filesz - off;
+  if(n > PGSIZE)
+    n = PGSIZE;
+
+  begin_op();
+  ilock(v->ip);
+  writei(v->ip, 0, pa, v->off + off, n);
+  iunlock(v->ip);
+  end_op();
+}
+
+// Unmap p's pages of mmap() region v between start and end,
+// writing dirty pages of a shared file mapping back first.
+static void
+vmaunmappages(struct proc *p, struct vma *v, uint64 start, uint64 end)
+{
+  pte_t *pte;
+
+  for(uint64 va = start; va < end; va += PGSIZE){
+    if((pte = walk(p->pagetable, va, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;
+    if((v->flags & MAP_SHARED) && v->ip && (*pte & PTE_D))
+      vmawrite(v, va, PTE2PA(*pte));
+    uvmunmap(p->pagetable, va, 1, 1);
+  }
+}
+
+// The heap may grow up to the lowest of p's mmap() regions,
+// or to the trapframe if there are none.
+uint64
+vmaheaptop(struct proc *p)
+{
+  uint64 top = TRAPFRAME;
+
+  for(struct vma *v = p->vmas; v < &p->vmas[NVMA]; v++)
+    if(vmaused(v) && v->flags && v->start < top)
+      top = v->start;
+  return top;
+}
+
+// Add an mmap() region of len bytes to p, backed by ip
+// (if not 0) from offset off, of which filesz bytes are
+// valid. Picks the highest free addresses below MMAPTOP.
+// Returns the region's address, or -1.
+uint64
+vmamap(struct proc *p, uint64 len, int perm, int flags,
+       struct inode *ip, uint off, uint filesz)
+{
+  struct vma *v, *w = 0;
+  uint64 end = MMAPTOP;
+  int moved;
+
+  len = PGROUNDUP(len);
+  for(v = p->vmas; v < &p->vmas[NVMA]; v++)
+    if(!vmaused(v))
+      w = v;
+  if(w == 0)
+    return -1;
+
+  // move down past every region that overlaps.
+  do {
+    moved = 0;
+    if(end < len)
+      return -1;
+    for(v = p->vmas; v < &p->vmas[NVMA]; v++){
+      if(vmaused(v) && v->start < end && end - len < v->end){
+        end = v->start;
+        moved = 1;
+      }
+    }
+  } while(moved);
+  if(end < len || end - len < PGROUNDUP(p->sz))
+    return -1;
+
+  w->start = end - len;
+  w->end = end;
+  w->ip = ip ? idup(ip) : 0;
+  w->off = off;
+  w->filesz = filesz;
+  w->perm = perm;
+  w->flags = flags;
+  return w->start;
+}
+
+// Remove the pages from addr to addr+len from p's mmap()
+// regions. They must lie within a single region.
+// Must not be called inside a transaction.
+// Returns 0 on success, -1 on error.
+int
+vmaunmap(struct proc *p, uint64 addr, uint64 len)
+{
+  struct vma *v, *w = 0;
+  uint64 end, d;
+
+  if(addr % PGSIZE != 0 || len == 0 || addr + len < addr)
+    return -1;
+  end = PGROUNDUP(addr + len);
+  if((v = vmalookup(p, addr)) == 0 || v->flags == 0 || end > v->end)
+    return -1;
+
+  if(addr > v->start && end < v->end){
+    // punching a hole needs a second region.
+    for(w = p->vmas; w < &p->vmas[NVMA]; w++)
+      if(!vmaused(w))
+        break;
+    if(w == &p->vmas[NVMA])
+      return -1;
+  }
+
+  vmaunmappages(p, v, addr, end);
+
+  if(addr == v->start && end == v->end){
+    if(v->ip){
+      begin_op();
+      iput(v->ip);
+      end_op();
+    }
+    memset(v, 0, sizeof(*v));
+    return 0;
+  }
+
+  if(w){
+    // the part after the hole.
+    *w = *v;
+    if(w->ip)
+      idup(w->ip);
+    d = end - v->start;
+    w->start = end;
+    w->off += d;
+    w->filesz = w->filesz > d ? w->filesz - d : 0;
+  }
+  if(addr == v->start){
+    d = end - v->start;
+    v->start = end;
+    v->off += d;
+    v->filesz = v->filesz > d ? v->filesz - d : 0;
+  } else {
+    v->end = addr;
+    if(v->filesz > addr - v->start)
+      v->filesz = addr - v->start;
+  }
+  return 0;
+}
+
+// Act on madvise() advice for the pages from addr to addr+len,
+// which must all be p's, in the heap or one of its regions.
+// MADV_DONTNEED unmaps and frees them, writing dirty pages of
+// a shared file mapping back first; vmfault() brings them back
+// as it would have the first time. MADV_WILLNEED faults in
+// those not mapped yet.
+// Must not be called inside a transaction.
+// Returns 0 on success, -1 on error or if out of memory.
+int
+vmaadvise(struct proc *p, uint64 addr, uint64 len, int advice)
+{
+  struct vma *v;
+  pte_t *pte;
+  uint64 va, next, end;
+
+  if(addr % PGSIZE != 0 || addr + len < addr)
+    return -1;
+  if(advice != MADV_DONTNEED && advice != MADV_WILLNEED)
+    return -1;
+  end = PGROUNDUP(addr + len);
+  for(va = addr; va < end; va += PGSIZE){
+    v = vmalookup(p, va);
+    if(va >= p->sz && v == 0)
+      return -1;
+    // e.g. the stack guard page.
+    if((pte = walk(p->pagetable, va, 0)) != 0 && (*pte & (PTE_V|PTE_U)) == PTE_V)
+      return -1;
+    // a shared anonymous page would be lost.
+    if(advice == MADV_DONTNEED && v && (v->flags & MAP_SHARED) && v->ip == 0)
+      return -1;
+  }
+
+  if(advice == MADV_DONTNEED){
+    // unmap each run of pages in the same region (or in none)
+    // at once, so huge pages go whole and the TLB is flushed once.
+    for(va = addr; va < end; va = next){
+      v = vmalookup(p, va);
+      for(next = va + PGSIZE; next < end && vmalookup(p, next) == v; next += PGSIZE)
+        ;
+      if(v && (v->flags & MAP_SHARED))
+        vmaunmappages(p, v, va, next);
+      else
+        uvmunmap(p->pagetable, va, (next - va) / PGSIZE, 1);
+    }
+    return 0;
+  }
+
+  for(va = addr; va < end; va += PGSIZE){
+    if((pte = walk(p->pagetable, va, 0)) != 0 && (*pte & PTE_V))
+      continue;
+    v = vmalookup(p, va);
+    if(vmprefault(p->pagetable, va, v && (v->perm & PTE_W) == 0) == 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Give np, a new child of p, p's regions. Pages of mmap()
+// regions are shared with the child: copy-on-write for
+// private ones, outright for shared ones, which are
+// faulted in first so that parent and child see the
+// same pages. Called by p.
+// Returns 0 on success, -1 if out of memory.
+int
+vmadup(struct proc *np, struct proc *p)
+{
+  struct vma *v;
+  int i;
+
+  for(i = 0; i < NVMA; i++){
+    v = &p->vmas[i];
+    if(!vmaused(v) || v->flags == 0)
+      continue;
+    if(v->flags & MAP_SHARED){
+      for(uint64 va = v->start; va < v->end; va += PGSIZE)
+        if(!ismapped(p->pagetable, va) && vmfault(p->pagetable, va, 1) == 0)
+          goto bad;
+    }
+    if(uvmshare(p->pagetable, np->pagetable, v->start, v->end,
+                (v->flags & MAP_SHARED) == 0) < 0)
+      goto bad;
+  }
+
+  for(i = 0; i < NVMA; i++){
+    np->vmas[i] = p->vmas[i];
+    if(np->vmas[i].ip)
+      idup(np->vmas[i].ip);
+  }
+  return 0;
+
+ bad:
+  while(--i >= 0){
+    v = &p->vmas[i];
+    if(vmaused(v) && v->flags)
+      uvmunmap(np->pagetable, v->start, (v->end - v->start) / PGSIZE, 1);
+  }
+  return -1;
+}
+
+// Unmap all of p's mmap() regions and drop all its regions.
+// Must not be called inside a transaction.
+void
+vmafree(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vmas; v < &p->vmas[NVMA]; v++)
+    if(vmaused(v) && v->flags)
+      vmaunmappages(p, v, v->start, v->end);
+
+  begin_op();
+  vmaclear(p->vmas);
+  end_op();
+}
+
+// Drop the regions in vmas[NVMA], whose pages
+// must already be unmapped or below p->sz.
+// Must be called inside a transaction, for iput().
+void
+vmaclear(struct vma *vmas)
+{
+  for(int i = 0; i < NVMA; i++){
+    if(vmas[i].ip)
+      iput(vmas[i].ip);
+    memset(&vmas[i], 0, sizeof(vmas[i]));
+  }
+}
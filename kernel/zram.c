@@ -0,0 +1,207 @@
+// Compressed swap in memory ("zram").
+//
+// swapreclaim() first tries to evict a page by compressing it
+// into the pool here, and writes it to the swap disk only if it
+// doesn't compress well enough. Zero-filled pages, which lazily
+// grown heaps are full of, take no space at all; others are
+// compressed with LZ4 (see lz4.c) into kmalloc() memory.
+//
+// The pool keeps one spare page, and gives it to kmalloc() if
+// that finds memory exhausted, which it will be the first time
+// swapreclaim() runs; swapreclaim() hands a page back from those
+// it frees.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "kalloc.h"
+#include "defs.h"
+
+#define ZMAX      16384  // most pages held
+#define ZMAXLEN   1024   // longest compressed page kept; kmalloc()
+                         // would hold a longer one in a page of its own
+#define ZMAXBYTES ((PHYSTOP - KERNBASE) / 4)  // most memory held
+
+struct zpage {
+  uchar *data;    // compressed contents; 0 if all zeros
+  ushort len;     // bytes at data
+  ushort refs;    // PTEs referring to this page; 0 if free
+};
+
+static struct {
+  struct spinlock lock;
+  struct zpage pages[ZMAX];
+  uint next;            // where to start looking for a free entry
+  uint nused;
+  uint64 nbytes;        // compressed bytes held
+  uint64 nmem;          // kmalloc() memory they take
+  uint64 nzero;         // pages held that are all zeros
+  uint64 nout;          // pages ever compressed
+  uint64 nreject;       // pages that didn't compress well enough
+  void *spare;          // a page for kmalloc() in a pinch
+  uchar buf[ZMAXLEN];   // compressor output
+  ushort tab[4096];     // compressor hash table
+} zram;
+
+void
+zraminit(void)
+{
+  initlock(&zram.lock, "zram");
+  zram.spare = kalloc();
+}
+
+// Give zram the page pa, if it has used its spare.
+// Returns 1 if it took it, 0 if the caller keeps it.
+int
+zramrefill(void *pa)
+{
+  int took = 0;
+
+  acquire(&zram.lock);
+  if(zram.spare == 0){
+    zram.spare = pa;
+    took = 1;
+  }
+  release(&zram.lock);
+  return took;
+}
+
+// kmalloc() memory taken by a compressed page of n bytes.
+static uint
+zsize(uint n)
+{
+  uint sz = 16;
+
+  while(sz < n)
+    sz <<= 1;
+  return sz;
+}
+
+static int
+iszero(uint64 *pa)
+{
+  for(int i = 0; i < PGSIZE / sizeof(uint64); i++)
+    if(pa[i])
+      return 0;
+  return 1;
+}
+
+// Compress the page at pa into the pool.
+// Returns its entry, ZREJECT if it doesn't compress well
+// enough, or -1 if the pool is full.
+int
+zramput(void *pa)
+{
+  uchar *data = 0;
+  int len = 0, z = -1;
+
+  acquire(&zram.lock);
+  if(zram.nused == ZMAX)
+    goto out;
+  if(!iszero(pa)){
+    len = lz4_compress(pa, PGSIZE, zram.buf, ZMAXLEN, zram.tab);
+    if(len < 0){
+      zram.nreject++;
+      z = ZREJECT;
+      goto out;
+    }
+    if(zram.nmem + zsize(len) > ZMAXBYTES)
+      goto out;
+    if((data = kmalloc(len)) == 0 && zram.spare){
+      kfree(zram.spare);
+      zram.spare = 0;
+      data = kmalloc(len);
+    }
+    if(data == 0)
+      goto out;
+    memmove(data, zram.buf, len);
+  }
+  for(uint i = 0; i < ZMAX; i++){
+    uint j = (zram.next + i) % ZMAX;
+    if(zram.pages[j].refs == 0){
+      z = j;
+      break;
+    }
+  }
+  zram.pages[z].data = data;
+  zram.pages[z].len = len;
+  zram.pages[z].refs = 1;
+  zram.next = z + 1;
+  zram.nused++;
+  zram.nout++;
+  if(data){
+    zram.nbytes += len;
+    zram.nmem += zsize(len);
+  } else {
+    zram.nzero++;
+  }
+ out:
+  release(&zram.lock);
+  return z;
+}
+
+// Decompress entry z into the page at pa.
+void
+zramget(uint z, void *pa)
+{
+  struct zpage *zp = &zram.pages[z];
+
+  acquire(&zram.lock);
+  if(z >= ZMAX || zp->refs == 0)
+    panic("zramget");
+  if(zp->data == 0)
+    memset(pa, 0, PGSIZE);
+  else if(lz4_decompress(zp->data, zp->len, pa, PGSIZE) != PGSIZE)
+    panic("zramget: corrupt");
+  release(&zram.lock);
+}
+
+// Another PTE refers to entry z.
+void
+zramdup(uint z)
+{
+  acquire(&zram.lock);
+  if(z >= ZMAX || zram.pages[z].refs == 0 || zram.pages[z].refs == 0xffff)
+    panic("zramdup");
+  zram.pages[z].refs++;
+  release(&zram.lock);
+}
+
+// A PTE no longer refers to entry z.
+void
+zramfree(uint z)
+{
+  struct zpage *zp = &zram.pages[z];
+
+  acquire(&zram.lock);
+  if(z >= ZMAX || zp->refs == 0)
+    panic("zramfree");
+  if(--zp->refs == 0){
+    if(zp->data){
+      kmfree(zp->data);
+      zram.nbytes -= zp->len;
+      zram.nmem -= zsize(zp->len);
+    } else {
+      zram.nzero--;
+    }
+    zp->data = 0;
+    zram.nused--;
+  }
+  release(&zram.lock);
+}
+
+// Pool usage, for kmeminfo().
+void
+zraminfo(struct kmeminfo *mi)
+{
+  acquire(&zram.lock);
+  mi->nzram = zram.nused;
+  mi->nzramzero = zram.nzero;
+  mi->nzrambytes = zram.nbytes;
+  mi->nzrammem = zram.nmem;
+  mi->nzramout = zram.nout;
+  mi->nzramreject = zram.nreject;
+  release(&zram.lock);
+}
@@ -0,0 +1,86 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+// Copy-heavy benchmark: the kernel memmove()s every byte between
+// user buffers and pipe buffers or the buffer cache, through its
+// direct map of RAM. Compare a normal kernel (2 MiB pages for the
+// direct map) with one built with make KVM_4K=1, which needs a TLB
+// entry for every 4 KiB page the copies touch.
+
+#define CHUNK   (24*1024)  // fits in the buffer cache
+#define ROUNDS  200
+
+char buf[CHUNK];
+
+// read the same cached file over and over.
+void file_bench(void) {
+    char *name = "copybench.tmp";
+    int fd;
+
+    unlink(name);
+    if ((fd = open(name, O_CREATE|O_WRONLY)) < 0 || write(fd, buf, CHUNK) != CHUNK) {
+        printf("copybench: cannot create %s\n", name);
+        exit(1);
+    }
+    close(fd);
+
+    uint64 start_time = uptime();
+    for (int r = 0; r < ROUNDS; r++) {
+        if ((fd = open(name, O_RDONLY)) < 0 || read(fd, buf, CHUNK) != CHUNK) {
+            printf("copybench: read failed\n");
+            exit(1);
+        }
+        close(fd);
+    }
+    report("file read", (uint64)ROUNDS * CHUNK / 1024, uptime() - start_time);
+    unlink(name);
+}
+
+// push data through a pipe to a child.
+void pipe_bench(void) {
+    int fds[2];
+
+    if (pipe(fds) < 0) {
+        printf("copybench: pipe failed\n");
+        exit(1);
+    }
+    uint64 start_time = uptime();
+    int pid = fork();
+    if (pid < 0) {
+        printf("copybench: fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        close(fds[1]);
+        while (read(fds[0], buf, CHUNK) > 0)
+            ;
+        exit(0);
+    }
+    close(fds[0]);
+    for (int r = 0; r < ROUNDS; r++) {
+        if (write(fds[1], buf, CHUNK) != CHUNK) {
+            printf("copybench: write failed\n");
+            exit(1);
+        }
+    }
+    close(fds[1]);
+    wait(0);
+    report("pipe\t", (uint64)ROUNDS * CHUNK / 1024, uptime() - start_time);
+}
+
+int main(int argc, char *argv[]) {
+    printf("=========================================\n");
+    printf("    KERNEL COPY BENCHMARK\n");
+    printf("=========================================\n");
+    printf("test\t\tKiB\tticks\tKiB/sec\n");
+
+    for (int i = 0; i < CHUNK; i++)
+        buf[i] = i;
+    file_bench();
+    pipe_bench();
+
+    printf("=========================================\n");
+    exit(0);
+}
@@ -0,0 +1,77 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+// fork() and fork()+exec() latency for growing process sizes.
+// With copy-on-write fork, the cost should track the size of
+// the page table rather than the amount of memory, and the
+// child that execs right away should copy (almost) nothing.
+
+#define ITERS   50
+
+char *self;
+
+// fork ITERS children that either exit or exec a copy of
+// ourselves that exits, and return the ticks taken.
+uint64 run(int doexec) {
+    uint64 start_time = uptime();
+
+    for (int i = 0; i < ITERS; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("forkbench: fork failed\n");
+            exit(1);
+        }
+        if (pid == 0) {
+            if (doexec) {
+                char *argv[] = { self, "-exit", 0 };
+                exec(self, argv);
+                printf("forkbench: exec %s failed\n", self);
+                exit(1);
+            }
+            exit(0);
+        }
+        int status;
+        wait(&status);
+        if (status != 0)
+            exit(1);
+    }
+    return uptime() - start_time;
+}
+
+int main(int argc, char *argv[]) {
+    int sizes[] = { 0, 1, 4, 16 };   // extra heap, in MiB
+
+    self = argv[0];
+    if (argc > 1 && strcmp(argv[1], "-exit") == 0)
+        exit(0);
+
+    printf("=========================================\n");
+    printf("    FORK / FORK+EXEC LATENCY BENCHMARK\n");
+    printf("=========================================\n");
+    printf("%d forks per test\n\n", ITERS);
+    printf("heap MiB   fork ticks   fork/sec   fork+exec ticks   fork+exec/sec\n");
+
+    uint64 grown = 0;
+    for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        uint64 want = (uint64)sizes[s] * 1024 * 1024;
+        char *p = sbrk(want - grown);
+        if (p == SBRK_ERROR) {
+            printf("forkbench: sbrk failed\n");
+            exit(1);
+        }
+        // dirty every page, so the parent really owns them.
+        for (uint64 off = 0; off < want - grown; off += PGSIZE)
+            p[off] = 1;
+        grown = want;
+
+        uint64 f = run(0);
+        uint64 fe = run(1);
+        printf("%d          %lu            %lu        %lu                 %lu\n",
+               sizes[s], f, persec(ITERS, f), fe, persec(ITERS, fe));
+    }
+
+    printf("=========================================\n");
+    exit(0);
+}
@@ -1,11 +1,12 @@
 // Test that fork fails gracefully.
-// Tiny executable so that the limit can be filling the proc table.
+// Tiny executable so that the limit is the memory each new
+// process needs, which is what bounds the process table.
 
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "user/user.h"
 
-#define N  1000
+#define N  100000
 
 void
 print(const char *s)
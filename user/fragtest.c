@@ -0,0 +1,158 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "kernel/kalloc.h"
+#include "user/user.h"
+
+// Physical memory fragmentation stress test for the buddy
+// allocator. A ring of processes takes turns growing their
+// heaps one page at a time, so their pages interleave in
+// physical memory. Killing every other process then leaves
+// single-page holes; once the rest exit too, the buddy
+// allocator should have merged everything back together.
+//
+// A small warm-up run first faults in every text and stack
+// page the test uses, so that the runs leave nothing behind.
+// Snapshots are taken with kmemdrain(), which gives the
+// per-hart and pre-zeroed caches back to the buddy allocator
+// first. The test passes when as many pages are in order-
+// KMAXORDER blocks as before; freed process chunks are only
+// reclaimed once every hart has been through its scheduler,
+// so it checks once a tick for up to MAXWAIT ticks.
+
+#define NCHILD  8
+#define NPAGES  256   // pages per child
+#define MAXWAIT 10    // ticks to wait for the last frees
+
+void print_info(char *when, struct kmeminfo *mi) {
+    uint64 big = mi->nblocks[KMAXORDER] << KMAXORDER;
+
+    printf("%s: %lu free pages (%lu cached), %lu%% in order-%d blocks\n",
+           when, mi->nfree, mi->ncached,
+           mi->nfree ? big * 100 / mi->nfree : 0, KMAXORDER);
+    printf("  blocks by order:");
+    for (int k = 0; k <= KMAXORDER; k++)
+        printf(" %lu", mi->nblocks[k]);
+    printf("\n");
+}
+
+// Grow the heap by one page each time the token comes round.
+void ring_task(int in, int out, int npages) {
+    char c;
+
+    for (int i = 0; i < npages; i++) {
+        if (read(in, &c, 1) != 1)
+            exit(1);
+        char *p = sbrk(PGSIZE);
+        if (p == SBRK_ERROR)
+            exit(1);
+        *p = i;
+        write(out, &c, 1);
+    }
+    // hold on to the pages until killed. not by reading the
+    // ring: killing the previous child would close it.
+    for (;;)
+        pause(100);
+}
+
+// Run the ring with npages pages per child, kill every
+// other child, report if verbose, then kill the rest.
+void fragment(int npages, int verbose) {
+    struct kmeminfo holes;
+    int pids[NCHILD];
+    int first[2], next[2], in;
+    char c = 'x';
+
+    if (pipe(first) < 0) {
+        printf("fragtest: pipe failed\n");
+        exit(1);
+    }
+    in = first[0];
+    for (int i = 0; i < NCHILD; i++) {
+        if (pipe(next) < 0) {
+            printf("fragtest: pipe failed\n");
+            exit(1);
+        }
+        pids[i] = fork();
+        if (pids[i] < 0) {
+            printf("fragtest: fork failed\n");
+            exit(1);
+        }
+        if (pids[i] == 0) {
+            close(next[0]);
+            ring_task(in, next[1], npages);
+        }
+        close(in);
+        close(next[1]);
+        in = next[0];
+    }
+
+    // pass the token round the ring once per page.
+    for (int i = 0; i < npages; i++) {
+        write(first[1], &c, 1);
+        if (read(in, &c, 1) != 1) {
+            printf("fragtest: ring broken\n");
+            exit(1);
+        }
+    }
+
+    for (int i = 0; i < NCHILD; i += 2)
+        kill(pids[i]);
+    for (int i = 0; i < NCHILD; i += 2) {
+        int pid = wait(0), j;
+        for (j = 0; j < NCHILD && pids[j] != pid; j++)
+            ;
+        if (j == NCHILD || j % 2 != 0) {
+            printf("fragtest: wrong child %d exited\n", pid);
+            exit(1);
+        }
+    }
+    for (int i = 1; i < NCHILD; i += 2) {
+        struct procinfo info;
+        if (getprocinfo(pids[i], &info) < 0 || info.end_time != 0) {
+            printf("fragtest: child %d exited too soon\n", pids[i]);
+            exit(1);
+        }
+    }
+    kmemdrain(&holes);
+    if (verbose)
+        print_info("every other process exited", &holes);
+
+    for (int i = 1; i < NCHILD; i += 2)
+        kill(pids[i]);
+    for (int i = 1; i < NCHILD; i += 2)
+        wait(0);
+    close(first[1]);
+    close(in);
+}
+
+int main(int argc, char *argv[]) {
+    struct kmeminfo before, after;
+    int t;
+
+    printf("=========================================\n");
+    printf("    BUDDY ALLOCATOR FRAGMENTATION TEST\n");
+    printf("=========================================\n");
+
+    fragment(1, 0);
+    kmemdrain(&before);
+    print_info("start", &before);
+
+    fragment(NPAGES, 1);
+
+    for (t = 0; ; t++) {
+        kmemdrain(&after);
+        if (after.nblocks[KMAXORDER] >= before.nblocks[KMAXORDER] || t == MAXWAIT)
+            break;
+        pause(1);
+    }
+    print_info("all exited", &after);
+
+    if (after.nblocks[KMAXORDER] < before.nblocks[KMAXORDER]) {
+        printf("fragtest: FAILED -- %lu order-%d blocks not rebuilt\n",
+               before.nblocks[KMAXORDER] - after.nblocks[KMAXORDER], KMAXORDER);
+        exit(1);
+    }
+    printf("fragtest: OK after %d ticks\n", t);
+    exit(0);
+}
@@ -3,30 +3,53 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/mman.h"
 #include "user/user.h"
 
 char buf[1024];
 int match(char*, char*);
 
+// print the matching lines among the complete lines
+// in p..end, which must be writable. returns the start
+// of the incomplete last line.
+char*
+grepbuf(char *pattern, char *p, char *end)
+{
+  char *q;
+
+  for(q = p; q < end; q++){
+    if(*q != '\n')
+      continue;
+    *q = 0;
+    if(match(pattern, p)){
+      *q = '\n';
+      write(1, p, q+1 - p);
+    }
+    *q = '\n';
+    p = q+1;
+  }
+  return p;
+}
+
 void
 grep(char *pattern, int fd)
 {
   int n, m;
-  char *p, *q;
+  struct stat st;
+  char *p;
+
+  // search a regular file in place rather than copying it.
+  if(fstat(fd, &st) == 0 && st.type == T_FILE && st.size > 0 &&
+     (p = mmap(0, st.size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0)) != MAP_FAILED){
+    grepbuf(pattern, p, p + st.size);
+    munmap(p, st.size);
+    return;
+  }
 
   m = 0;
   while((n = read(fd, buf+m, sizeof(buf)-m-1)) > 0){
     m += n;
-    buf[m] = '\0';
-    p = buf;
-    while((q = strchr(p, '\n')) != 0){
-      *q = 0;
-      if(match(pattern, p)){
-        *q = '\n';
-        write(1, p, q+1 - p);
-      }
-      p = q+1;
-    }
+    p = grepbuf(pattern, buf, buf+m);
     if(m > 0){
       m -= p - buf;
       memmove(buf, p, m);
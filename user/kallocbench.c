@@ -0,0 +1,84 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "kernel/kalloc.h"
+#include "user/user.h"
+
+// kalloc contention benchmark: N processes each grow their heap
+// lazily and touch every page, so that every page comes from a
+// vmfault() -> kalloc(), and then shrink it again (kfree()).
+// Runs with N = 1, 2, 4, ... up to the argument (default 8).
+// Only min(N, harts) processes can allocate at once, so to see
+// how page allocation scales with harts, compare the rows with
+// N up to the hart count, or boot with make CPUS=1, 2, 4, ...
+// and compare the same N; rows past the hart count show the
+// cost of more processes than harts instead.
+
+#define NPAGES  256   // pages faulted in per round
+#define ROUNDS  8     // grow/shrink rounds per process
+
+void fault_task(void) {
+    for (int r = 0; r < ROUNDS; r++) {
+        char *p = sbrklazy(NPAGES * PGSIZE);
+        if (p == SBRK_ERROR) {
+            printf("kallocbench: sbrklazy failed\n");
+            exit(1);
+        }
+        for (int i = 0; i < NPAGES; i++)
+            p[i * PGSIZE] = i;
+        if (sbrk(-(NPAGES * PGSIZE)) == SBRK_ERROR) {
+            printf("kallocbench: sbrk shrink failed\n");
+            exit(1);
+        }
+    }
+    exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    int maxprocs = 8;
+    struct kmeminfo mi;
+
+    if (argc > 1)
+        maxprocs = atoi(argv[1]);
+    kmeminfo(&mi);
+
+    printf("=========================================\n");
+    printf("    KALLOC CONTENTION BENCHMARK\n");
+    printf("=========================================\n");
+    printf("%lu harts; %d pages x %d rounds per process\n\n",
+           mi.ncpu, NPAGES, ROUNDS);
+    printf("procs    busy harts    pages    ticks    pages/sec\n");
+
+    for (int n = 1; n <= maxprocs; n *= 2) {
+        uint64 start_time = uptime();
+
+        for (int i = 0; i < n; i++) {
+            int pid = fork();
+            if (pid < 0) {
+                printf("kallocbench: fork failed\n");
+                exit(1);
+            }
+            if (pid == 0)
+                fault_task();
+        }
+
+        int failed = 0;
+        for (int i = 0; i < n; i++) {
+            int status;
+            wait(&status);
+            if (status != 0)
+                failed = 1;
+        }
+        if (failed)
+            exit(1);
+
+        uint64 ticks = uptime() - start_time;
+        uint64 pages = (uint64)n * NPAGES * ROUNDS;
+        printf("%d        %lu             %lu    %lu       %lu\n",
+               n, n < mi.ncpu ? n : mi.ncpu, pages, ticks,
+               persec(pages, ticks));
+    }
+
+    printf("=========================================\n");
+    exit(0);
+}
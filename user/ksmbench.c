@@ -0,0 +1,104 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "kernel/kalloc.h"
+#include "user/user.h"
+
+// Same-page merging benchmark: start identical workers that
+// each build the same table in their heaps, then sit idle while
+// a kernel built with make KSM=1 merges their copies. Reports
+// the pages saved over time, then has each worker check its
+// table and write to part of it, which must unmerge those pages.
+
+#define NCHILD   4
+#define NPAGES   256      // table pages per worker: 1 MiB
+#define WAIT     100      // ticks to wait for merging
+
+// the word at index i of the table.
+uint64 entry(uint64 i) {
+    return i * 0x9e3779b97f4a7c15UL;
+}
+
+void worker(int n, int go) {
+    uint64 *t = (uint64 *)sbrk(NPAGES * PGSIZE);
+    char c;
+
+    if (t == (uint64 *)SBRK_ERROR) {
+        printf("ksmbench: sbrk failed\n");
+        exit(1);
+    }
+    for (uint64 i = 0; i < NPAGES * PGSIZE / 8; i++)
+        t[i] = entry(i);
+    // wait for the parent to say the merging is over.
+    if (read(go, &c, 1) != 1)
+        exit(1);
+    for (uint64 i = 0; i < NPAGES * PGSIZE / 8; i++) {
+        if (t[i] != entry(i)) {
+            printf("ksmbench: worker %d: wrong entry %lu\n", n, i);
+            exit(1);
+        }
+    }
+    // write to one page in four; no one else may see it.
+    for (uint64 pg = n % 4; pg < NPAGES; pg += 4)
+        t[pg * PGSIZE / 8] = n;
+    for (uint64 pg = 0; pg < NPAGES; pg++) {
+        uint64 want = pg % 4 == n % 4 ? n : entry(pg * PGSIZE / 8);
+        if (t[pg * PGSIZE / 8] != want) {
+            printf("ksmbench: worker %d: wrong page %lu after write\n", n, pg);
+            exit(1);
+        }
+    }
+    exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    struct kmeminfo start, mi;
+    int fds[2], failed = 0;
+
+    printf("=========================================\n");
+    printf("    SAME-PAGE MERGING BENCHMARK\n");
+    printf("=========================================\n");
+    printf("%d workers with %d identical table pages each\n", NCHILD, NPAGES);
+
+    if (pipe(fds) < 0) {
+        printf("ksmbench: pipe failed\n");
+        exit(1);
+    }
+    kmeminfo(&start);
+    for (int n = 0; n < NCHILD; n++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("ksmbench: fork failed\n");
+            exit(1);
+        }
+        if (pid == 0) {
+            close(fds[1]);
+            worker(n, fds[0]);
+        }
+    }
+    close(fds[0]);
+
+    printf("ticks    merged    saved    free pages\n");
+    for (int t = 0; t <= WAIT; t += WAIT / 10) {
+        kmeminfo(&mi);
+        printf("%d      %lu       %lu      %lu\n", t,
+               mi.nksmmerged - start.nksmmerged, mi.nksmsaved, mi.nfree);
+        pause(WAIT / 10);
+    }
+    if (mi.nksmmerged == start.nksmmerged)
+        printf("nothing merged; was the kernel built with make KSM=1?\n");
+
+    // let the workers check their tables and unmerge.
+    for (int n = 0; n < NCHILD; n++)
+        write(fds[1], "g", 1);
+    close(fds[1]);
+    for (int n = 0; n < NCHILD; n++) {
+        int status;
+        wait(&status);
+        if (status != 0)
+            failed++;
+    }
+    printf("%d of %d workers failed\n", failed, NCHILD);
+    printf("=========================================\n");
+    exit(failed ? 1 : 0);
+}
@@ -0,0 +1,100 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// malloc() benchmark: each workload runs in a child of its own,
+// so that it starts with an empty heap, and reports malloc() and
+// free() calls per second and the most heap it needed.
+//
+//  churn:  allocate and free small blocks of one size, as a
+//          program building and tearing down a list does.
+//  mixed:  keep NSLOT blocks of random small sizes, replacing
+//          a random one at a time; every LARGEONE'th is large.
+//  large:  allocate and free blocks of 8 KiB to 512 KiB.
+
+#define NSLOT    2048
+#define LARGEONE 64
+#define ROUNDS   200000
+
+static uint64 seed = 1;
+static char *slot[NSLOT];
+
+uint rnd(void) {
+    seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+    return seed >> 33;
+}
+
+void *xmalloc(uint n) {
+    char *p = malloc(n);
+    if (p == 0) {
+        printf("mallocbench: malloc(%d) failed\n", n);
+        exit(1);
+    }
+    p[0] = p[n - 1] = 1;   // touch both ends
+    return p;
+}
+
+uint64 churn(void) {
+    for (int r = 0; r < ROUNDS / 64; r++) {
+        for (int i = 0; i < 64; i++)
+            slot[i] = xmalloc(40);
+        for (int i = 0; i < 64; i++)
+            free(slot[i]);
+    }
+    return (uint64)ROUNDS * 2;
+}
+
+uint64 mixed(void) {
+    for (int r = 0; r < ROUNDS; r++) {
+        int i = rnd() % NSLOT;
+        free(slot[i]);
+        if (rnd() % LARGEONE == 0)
+            slot[i] = xmalloc(4096 + rnd() % 65536);
+        else
+            slot[i] = xmalloc(1 + rnd() % 512);
+    }
+    return (uint64)ROUNDS * 2;
+}
+
+uint64 large(void) {
+    for (int r = 0; r < ROUNDS / 16; r++) {
+        int i = rnd() % 16;
+        free(slot[i]);
+        slot[i] = xmalloc(8192 << (rnd() % 7));
+    }
+    return (uint64)ROUNDS / 16 * 2;
+}
+
+void run(char *name, uint64 (*f)(void)) {
+    int pid = fork();
+
+    if (pid < 0) {
+        printf("mallocbench: fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        char *base = sbrk(0);
+        uint64 t0 = uptime();
+        uint64 ops = f();
+        uint64 ticks = uptime() - t0;
+        printf("%s\t%lu\t%lu\t%lu\t%lu\n", name, ops, ticks,
+               persec(ops, ticks), (uint64)(sbrk(0) - base) / 1024);
+        exit(0);
+    }
+    int status;
+    wait(&status);
+    if (status != 0)
+        exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    printf("=========================================\n");
+    printf("    MALLOC BENCHMARK\n");
+    printf("=========================================\n");
+    printf("test\tops\tticks\tops/sec\tpeak heap KiB\n");
+    run("churn", churn);
+    run("mixed", mixed);
+    run("large", large);
+    printf("=========================================\n");
+    exit(0);
+}
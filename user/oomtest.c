@@ -0,0 +1,111 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "kernel/kalloc.h"
+#include "user/user.h"
+
+// Out-of-memory test: a few small children hold on to a little
+// memory each while a hog grows its heap with pages that don't
+// compress, until memory and swap run out. The kernel should
+// kill the hog, which holds the most, and leave the others be;
+// the test fails if a small child dies or loses data, or if
+// the hog is still alive when it reaches its limit.
+
+#define MB      (1024*1024)
+#define NSMALL  3
+#define SMALLMB 1
+#define ROUNDS  10
+
+void small(int n) {
+    uint64 npages = SMALLMB * MB / PGSIZE;
+    uint64 *p = (uint64 *)sbrk(SMALLMB * MB);
+
+    if (p == (uint64 *)SBRK_ERROR) {
+        printf("oomtest: small child %d: sbrk failed\n", n);
+        exit(1);
+    }
+    for (uint64 i = 0; i < npages; i++)
+        p[i * PGSIZE / 8] = n * npages + i;
+    for (int r = 0; r < ROUNDS; r++) {
+        pause(10);
+        for (uint64 i = 0; i < npages; i++) {
+            if (p[i * PGSIZE / 8] != n * npages + i) {
+                printf("oomtest: small child %d: bad page %lu\n", n, i);
+                exit(1);
+            }
+        }
+    }
+    exit(0);
+}
+
+void hog(int limit) {
+    uint64 x = 1;
+
+    for (int mb = 0; mb < limit; mb++) {
+        uint64 *p = (uint64 *)sbrklazy(MB);
+        if (p == (uint64 *)SBRK_ERROR)
+            break;
+        for (int j = 0; j < MB / 8; j++)
+            p[j] = x = x * 6364136223846793005UL + 1442695040888963407UL;
+    }
+    exit(2);   // should have been killed before getting here
+}
+
+int main(int argc, char *argv[]) {
+    int limit = 1024;   // MiB the hog tries for
+    int failed = 0, status, hogpid;
+    struct kmeminfo before, after;
+    struct procinfo info;
+
+    if (argc > 1)
+        limit = atoi(argv[1]);
+
+    printf("=========================================\n");
+    printf("    OUT-OF-MEMORY TEST\n");
+    printf("=========================================\n");
+
+    kmeminfo(&before);
+    for (int n = 0; n < NSMALL; n++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("oomtest: fork failed\n");
+            exit(1);
+        }
+        if (pid == 0)
+            small(n);
+    }
+    pause(2);
+    if ((hogpid = fork()) < 0) {
+        printf("oomtest: fork failed\n");
+        exit(1);
+    }
+    if (hogpid == 0)
+        hog(limit);
+
+    printf("hog: tick\trss\tswapped\tpt\tfaults\tmajor\n");
+    uint64 start_time = uptime();
+    while (getprocinfo(hogpid, &info) == 0 && info.end_time == 0) {
+        printf("     %lu\t%lu\t%lu\t%lu\t%lu\t%lu\n",
+               uptime() - start_time, info.rss, info.nswapped,
+               info.nptpages, info.nfault, info.nmajfault);
+        pause(20);
+    }
+
+    for (int n = 0; n < NSMALL + 1; n++) {
+        int pid = wait(&status);
+        if (pid == hogpid) {
+            if (status != -1) {
+                printf("oomtest: hog exited with %d, not killed\n", status);
+                failed++;
+            }
+        } else if (status != 0) {
+            failed++;
+        }
+    }
+    kmeminfo(&after);
+
+    printf("%lu processes killed for lack of memory, %d failures\n",
+           after.noomkill - before.noomkill, failed);
+    printf("=========================================\n");
+    exit(failed ? 1 : 0);
+}
@@ -0,0 +1,78 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+// Page zero and copy throughput of the kernel's memset() and
+// memmove(). Touching freshly grown heap pages makes the kernel
+// zero them (4 KiB at a time, or 2 MiB for a huge page); writing
+// to pages shared copy-on-write with a parent makes it copy
+// them, 4 KiB at a time. Compare kernels built with and without
+// make RVV=1, on a QEMU with and without -cpu rv64,v=true.
+
+#define NPAGES  1024   // 4 MiB
+#define ROUNDS  16
+
+void zero_bench(void) {
+    uint64 start = uptime();
+
+    for (int r = 0; r < ROUNDS; r++) {
+        char *p = sbrklazy(NPAGES * PGSIZE);
+        if (p == SBRK_ERROR) {
+            printf("pagebench: sbrklazy failed\n");
+            exit(1);
+        }
+        for (int i = 0; i < NPAGES; i++)
+            p[i * PGSIZE] = 1;
+        if (sbrk(-(NPAGES * PGSIZE)) == SBRK_ERROR) {
+            printf("pagebench: sbrk shrink failed\n");
+            exit(1);
+        }
+    }
+    report("zero", (uint64)NPAGES * ROUNDS * PGSIZE / 1024, uptime() - start);
+}
+
+void copy_bench(void) {
+    char *p = sbrk(NPAGES * PGSIZE);
+    uint64 start;
+
+    if (p == SBRK_ERROR) {
+        printf("pagebench: sbrk failed\n");
+        exit(1);
+    }
+    for (int i = 0; i < NPAGES; i++)
+        p[i * PGSIZE] = 1;
+
+    start = uptime();
+    for (int r = 0; r < ROUNDS; r++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("pagebench: fork failed\n");
+            exit(1);
+        }
+        if (pid == 0) {
+            for (int i = 0; i < NPAGES; i++)
+                p[i * PGSIZE] = 2;
+            exit(0);
+        }
+        int status;
+        wait(&status);
+        if (status != 0)
+            exit(1);
+    }
+    report("copy", (uint64)NPAGES * ROUNDS * PGSIZE / 1024, uptime() - start);
+    sbrk(-(NPAGES * PGSIZE));
+}
+
+int main(int argc, char *argv[]) {
+    printf("=========================================\n");
+    printf("    PAGE ZERO AND COPY BENCHMARK\n");
+    printf("=========================================\n");
+    printf("test\tKiB\tticks\tKiB/sec\n");
+
+    zero_bench();
+    copy_bench();
+
+    printf("=========================================\n");
+    exit(0);
+}
@@ -1,15 +1,61 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/param.h"
 #include "user/user.h"
 
 #include <stdarg.h>
 
+// Output to each fd is buffered, and written by fflush(). For
+// the console, that is done at the end of each printf(), so a
+// call costs one write() however many characters it prints;
+// output to anything else, files and pipes (which fstat()
+// fails on) included, is written a buffer at a time.
+// Buffers are flushed before fork(), exec() and exit(), and
+// before close() of their fd, which also forgets what the fd
+// was, for the next file opened under it.
+
+#define BUFSZ 512
+
+enum { UNKNOWN, CONSOLE, FULL };
+
+static struct {
+  int mode;
+  int n;
+  char buf[BUFSZ];
+} out[NOFILE];
+
 static char digits[] = "0123456789ABCDEF";
 
+// write out fd's buffered output, or every fd's if fd < 0.
+int
+fflush(int fd)
+{
+  int r = 0;
+
+  if(fd < 0){
+    for(fd = 0; fd < NOFILE; fd++)
+      if(fflush(fd) < 0)
+        r = -1;
+    return r;
+  }
+  if(fd >= NOFILE || out[fd].n == 0)
+    return 0;
+  if(write(fd, out[fd].buf, out[fd].n) != out[fd].n)
+    r = -1;
+  out[fd].n = 0;
+  return r;
+}
+
 static void
 putc(int fd, char c)
 {
-  write(fd, &c, 1);
+  if(fd < 0 || fd >= NOFILE){
+    write(fd, &c, 1);
+    return;
+  }
+  out[fd].buf[out[fd].n++] = c;
+  if(out[fd].n == BUFSZ)
+    fflush(fd);
 }
 
 static void
@@ -53,6 +99,10 @@ vprintf(int fd, const char *fmt, va_list ap)
 {
   char *s;
   int c0, c1, c2, i, state;
+  struct stat st;
+
+  if(fd >= 0 && fd < NOFILE && out[fd].mode == UNKNOWN)
+    out[fd].mode = fstat(fd, &st) == 0 && st.type == T_DEVICE ? CONSOLE : FULL;
 
   state = 0;
   for(i = 0; fmt[i]; i++){
@@ -111,6 +161,8 @@ vprintf(int fd, const char *fmt, va_list ap)
       state = 0;
     }
   }
+  if(fd < 0 || fd >= NOFILE || out[fd].mode == CONSOLE)
+    fflush(fd);
 }
 
 void
@@ -130,3 +182,35 @@ printf(const char *fmt, ...)
   va_start(ap, fmt);
   vprintf(1, fmt, ap);
 }
+
+// system calls that need the buffers flushed first.
+
+int
+fork(void)
+{
+  fflush(-1);
+  return sys_fork();
+}
+
+int
+exec(const char *path, char **argv)
+{
+  fflush(-1);
+  return sys_exec(path, argv);
+}
+
+int
+exit(int status)
+{
+  fflush(-1);
+  sys_exit(status);
+}
+
+int
+close(int fd)
+{
+  fflush(fd);
+  if(fd >= 0 && fd < NOFILE)
+    out[fd].mode = UNKNOWN;
+  return sys_close(fd);
+}
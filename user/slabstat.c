@@ -0,0 +1,42 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/kalloc.h"
+#include "user/user.h"
+
+// Print usage statistics of the kernel's slab caches.
+// With an argument n, first open n pipes, to show how many
+// pages they take.
+
+#define NCACHE 16
+
+int main(int argc, char *argv[]) {
+    struct slabinfo si[NCACHE];
+    int npipes = 0, n;
+
+    if (argc > 1)
+        npipes = atoi(argv[1]);
+    for (int i = 0; i < npipes; i++) {
+        int fds[2];
+        if (pipe(fds) < 0) {
+            printf("slabstat: pipe %d failed\n", i);
+            break;
+        }
+    }
+
+    n = slabinfo(si, NCACHE);
+    if (n < 0) {
+        printf("slabstat: slabinfo failed\n");
+        exit(1);
+    }
+
+    printf("cache           size  per-slab  slabs  in-use  cached  allocs\n");
+    for (int i = 0; i < n; i++) {
+        printf("%s", si[i].name);
+        for (int j = strlen(si[i].name); j < 16; j++)
+            printf(" ");
+        printf("%d  %d  %lu  %lu  %lu  %lu\n",
+               si[i].objsize, si[i].perslab, si[i].nslabs,
+               si[i].inuse, si[i].ncached, si[i].nalloc);
+    }
+    exit(0);
+}
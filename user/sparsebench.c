@@ -0,0 +1,55 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "kernel/kalloc.h"
+#include "user/user.h"
+
+// Sparse heap benchmark: reserve a large lazy heap, read one
+// word of every page as a sparse lookup table would, then write
+// to a few of them. Reads map the kernel's shared zero page, so
+// should cost no memory; only the pages written should.
+
+#define MB      (1024*1024)
+#define WSTRIDE 16    // write one page in this many
+
+int main(int argc, char *argv[]) {
+    int mb = 64;
+    struct kmeminfo start, read, written;
+    uint64 sum = 0;
+
+    if (argc > 1)
+        mb = atoi(argv[1]);
+    uint64 npages = (uint64)mb * MB / PGSIZE;
+
+    printf("=========================================\n");
+    printf("    SPARSE HEAP BENCHMARK\n");
+    printf("=========================================\n");
+
+    kmeminfo(&start);
+    char *p = sbrklazy(mb * MB);
+    if (p == SBRK_ERROR) {
+        printf("sparsebench: sbrklazy failed\n");
+        exit(1);
+    }
+
+    uint64 t0 = uptime();
+    for (uint64 i = 0; i < npages; i++)
+        sum += p[i * PGSIZE];
+    uint64 read_ticks = uptime() - t0;
+    kmeminfo(&read);
+
+    t0 = uptime();
+    for (uint64 i = 0; i < npages; i += WSTRIDE)
+        p[i * PGSIZE] = 1;
+    uint64 write_ticks = uptime() - t0;
+    kmeminfo(&written);
+
+    printf("%d MiB heap, %lu pages (sum %lu)\n", mb, npages, sum);
+    printf("read all:     %lu ticks, %lu zero page faults, %lu pages used\n",
+           read_ticks, read.nzerofault - start.nzerofault,
+           start.nfree - read.nfree);
+    printf("write 1/%d:  %lu ticks, %lu pages used\n",
+           WSTRIDE, write_ticks, start.nfree - written.nfree);
+    printf("=========================================\n");
+    exit(0);
+}
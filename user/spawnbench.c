@@ -0,0 +1,84 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/kalloc.h"
+#include "user/user.h"
+
+// Memory use and exec() latency when running many copies of
+// one binary. With the shared text cache, every copy after the
+// first maps the same physical text pages, so each costs only
+// its data, stack and page tables.
+
+#define NCOPIES 8
+#define ITERS   50
+
+int main(int argc, char *argv[]) {
+    char *self = argv[0];
+    struct kmeminfo before, after;
+    int fds[2];
+    char c;
+
+    if (argc > 1 && strcmp(argv[1], "-exit") == 0)
+        exit(0);
+    if (argc > 1 && strcmp(argv[1], "-wait") == 0) {
+        read(0, &c, 1);
+        exit(0);
+    }
+
+    printf("=========================================\n");
+    printf("    SPAWN BENCHMARK\n");
+    printf("=========================================\n");
+
+    // exec latency, one copy at a time.
+    uint64 start_time = uptime();
+    for (int i = 0; i < ITERS; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("spawnbench: fork failed\n");
+            exit(1);
+        }
+        if (pid == 0) {
+            char *args[] = { self, "-exit", 0 };
+            exec(self, args);
+            exit(1);
+        }
+        wait(0);
+    }
+    uint64 ticks = uptime() - start_time;
+    printf("%d fork+exec: %lu ticks, %lu/sec\n",
+           ITERS, ticks, persec(ITERS, ticks));
+
+    // memory for many live copies.
+    if (pipe(fds) < 0) {
+        printf("spawnbench: pipe failed\n");
+        exit(1);
+    }
+    kmeminfo(&before);
+    for (int i = 0; i < NCOPIES; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("spawnbench: fork failed\n");
+            exit(1);
+        }
+        if (pid == 0) {
+            close(0);
+            dup(fds[0]);
+            close(fds[0]);
+            close(fds[1]);
+            char *args[] = { self, "-wait", 0 };
+            exec(self, args);
+            exit(1);
+        }
+    }
+    sleep(5);   // let them all reach read()
+    kmeminfo(&after);
+    printf("%d live copies: %lu pages, %lu per copy; %lu pages in text cache\n",
+           NCOPIES, before.nfree - after.nfree,
+           (before.nfree - after.nfree) / NCOPIES, after.ntext);
+
+    close(fds[0]);
+    close(fds[1]);
+    for (int i = 0; i < NCOPIES; i++)
+        wait(0);
+    printf("=========================================\n");
+    exit(0);
+}
@@ -0,0 +1,106 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// String routine benchmark: throughput of ulib.c's memset(),
+// memmove(), strlen() and strcmp() on buffers of different
+// sizes, against the byte-at-a-time loops they replaced.
+// "memmove+1" copies from a source one byte off alignment.
+
+#define MINTICKS      3   // run each case at least this long
+#define MAXSIZE       65536
+#define MB            (1024*1024)
+
+static char bufa[MAXSIZE + 16], bufb[MAXSIZE + 16];
+
+void *bytememset(void *dst, int c, uint n) {
+    char *d = dst;
+    for (uint i = 0; i < n; i++)
+        d[i] = c;
+    return dst;
+}
+
+void *bytememmove(void *dst, const void *src, int n) {
+    char *d = dst;
+    const char *s = src;
+    while (n-- > 0)
+        *d++ = *s++;
+    return dst;
+}
+
+uint bytestrlen(const char *s) {
+    int n;
+    for (n = 0; s[n]; n++)
+        ;
+    return n;
+}
+
+int bytestrcmp(const char *p, const char *q) {
+    while (*p && *p == *q)
+        p++, q++;
+    return (uchar)*p - (uchar)*q;
+}
+
+// one call of operation op on n bytes, with the library
+// routine if lib is set, else with the byte loop.
+void op(int which, int lib, int n) {
+    switch (which) {
+    case 0:
+        (lib ? memset : bytememset)(bufa, which, n);
+        break;
+    case 1:
+        (lib ? memmove : bytememmove)(bufa, bufb, n);
+        break;
+    case 2:
+        (lib ? memmove : bytememmove)(bufa, bufb + 1, n);
+        break;
+    case 3:
+        if ((lib ? strlen : bytestrlen)(bufa) != n - 1)
+            exit(1);
+        break;
+    case 4:
+        if ((lib ? strcmp : bytestrcmp)(bufa, bufb) != 0)
+            exit(1);
+        break;
+    }
+}
+
+// bytes per second of op on n-byte buffers.
+uint64 rate(int which, int lib, int n) {
+    uint64 bytes = 0, t0, ticks;
+
+    if (which >= 3) {
+        // strings of n - 1 characters, the same in both buffers.
+        memset(bufa, 'x', n - 1);
+        memset(bufb, 'x', n - 1);
+        bufa[n - 1] = bufb[n - 1] = 0;
+    }
+    t0 = uptime();
+    while ((ticks = uptime() - t0) < MINTICKS) {
+        for (int i = 0; i < MB / n + 1; i++)
+            op(which, lib, n);
+        bytes += (uint64)(MB / n + 1) * n;
+    }
+    return persec(bytes, ticks);
+}
+
+int main(int argc, char *argv[]) {
+    char *names[] = { "memset", "memmove", "memmove+1", "strlen", "strcmp" };
+    int sizes[] = { 16, 64, 256, 1024, 4096, MAXSIZE };
+
+    printf("=========================================\n");
+    printf("    STRING ROUTINE BENCHMARK\n");
+    printf("=========================================\n");
+    printf("routine\t\tsize\tbyte MB/s\tulib MB/s\tspeedup\n");
+    for (int w = 0; w < 5; w++) {
+        for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            int n = sizes[s];
+            uint64 slow = rate(w, 0, n), fast = rate(w, 1, n);
+            printf("%s\t%s%d\t%lu\t\t%lu\t\t%lu.%lux\n", names[w],
+                   w == 2 ? "" : "\t", n, slow / MB, fast / MB,
+                   fast / slow, fast * 10 / slow % 10);
+        }
+    }
+    printf("=========================================\n");
+    exit(0);
+}
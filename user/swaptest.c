@@ -0,0 +1,133 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "kernel/kalloc.h"
+#include "user/user.h"
+
+// Swap test: start more children than fit in memory together,
+// each filling a lazy heap with a pattern of its own, taking
+// turns to check it, then checking it once more at the end.
+// The pages of children that are waiting their turn have to be
+// swapped out for the others to fit; the test fails if any page
+// comes back with the wrong contents. Most pages hold a single
+// word, and compress well into zram; every NOISY'th is filled
+// with pseudo-random words, and has to go to the swap disk.
+
+#define MB       (1024*1024)
+#define NCHILD   6
+#define ROUNDS   3
+#define NOISY    4
+#define TIMEBASE 10   // r_time() units per microsecond on qemu
+
+// the first word stored in page i of child n.
+uint64 pattern(int n, uint64 i) {
+    return ((uint64)n << 32) ^ (i * 2654435761UL);
+}
+
+void fill(int n, uint64 *p, uint64 i) {
+    uint64 x = pattern(n, i);
+
+    p[0] = x;
+    if (i % NOISY == 0)
+        for (int j = 1; j < PGSIZE / 8; j++)
+            p[j] = x = x * 6364136223846793005UL + 1442695040888963407UL;
+}
+
+int check(int n, uint64 *p, uint64 npages) {
+    for (uint64 i = 0; i < npages; i++) {
+        uint64 *pg = p + i * PGSIZE / 8;
+        uint64 x = pattern(n, i);
+        if (pg[0] != x)
+            return -1;
+        for (int j = 1; j < PGSIZE / 8; j++) {
+            if (i % NOISY == 0)
+                x = x * 6364136223846793005UL + 1442695040888963407UL;
+            else
+                x = 0;
+            if (pg[j] != x)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+// average time per fault, in microseconds.
+uint64 avg(uint64 time, uint64 n) {
+    return n ? time / TIMEBASE / n : 0;
+}
+
+void child(int n, int mb) {
+    uint64 npages = (uint64)mb * MB / PGSIZE;
+    uint64 *p = (uint64 *)sbrklazy(mb * MB);
+
+    if (p == (uint64 *)SBRK_ERROR) {
+        printf("swaptest: child %d: sbrklazy failed\n", n);
+        exit(1);
+    }
+    for (uint64 i = 0; i < npages; i++)
+        fill(n, p + i * PGSIZE / 8, i);
+    for (int r = 0; r < ROUNDS; r++) {
+        pause(1 + n % 3);   // let the others run and push us out
+        if (check(n, p, npages) < 0) {
+            printf("swaptest: child %d: bad page in round %d\n", n, r);
+            exit(1);
+        }
+    }
+    exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    int mb = 24;
+    int failed = 0;
+    struct kmeminfo before, after;
+
+    if (argc > 1)
+        mb = atoi(argv[1]);
+
+    printf("=========================================\n");
+    printf("    SWAP TEST\n");
+    printf("=========================================\n");
+
+    kmeminfo(&before);
+    if (before.nswapslots == 0)
+        printf("no swap disk: some children may run out of memory\n");
+    printf("%d children of %d MiB each, %lu MiB of swap\n",
+           NCHILD, mb, before.nswapslots * PGSIZE / MB);
+
+    uint64 start_time = uptime();
+    for (int n = 0; n < NCHILD; n++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("swaptest: fork failed\n");
+            exit(1);
+        }
+        if (pid == 0)
+            child(n, mb);
+    }
+    for (int n = 0; n < NCHILD; n++) {
+        int status;
+        wait(&status);
+        if (status != 0)
+            failed++;
+    }
+    uint64 ticks = uptime() - start_time;
+    kmeminfo(&after);
+
+    printf("%lu ticks, %d of %d children failed\n", ticks, failed, NCHILD);
+    uint64 zin = after.nzramin - before.nzramin;
+    uint64 din = after.nswapin - before.nswapin;
+    printf("zram: %lu pages compressed, %lu rejected, %lu in, %lu us/fault\n",
+           after.nzramout - before.nzramout,
+           after.nzramreject - before.nzramreject,
+           zin, avg(after.zramintime - before.zramintime, zin));
+    printf("disk: %lu pages out, %lu in, %lu us/fault\n",
+           after.nswapout - before.nswapout, din,
+           avg(after.swapintime - before.swapintime, din));
+    printf("still held: %lu in zram (%lu zero) in %lu bytes, %lu on disk\n",
+           after.nzram, after.nzramzero, after.nzrammem, after.nswapused);
+    if (after.nzrambytes > 0)
+        printf("zram compression ratio of non-zero pages: %lu:1\n",
+               (after.nzram - after.nzramzero) * PGSIZE / after.nzrambytes);
+    printf("=========================================\n");
+    exit(failed ? 1 : 0);
+}
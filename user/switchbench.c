@@ -0,0 +1,90 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+// TLB benchmark for traps and context switches. Between
+// system calls, or between switches to and from a partner
+// process over a pair of pipes, each process touches a small
+// working set of pages. When every trap flushes the TLB, each
+// touch after it misses; with ASIDs the translations survive.
+// Compare against a kernel built with make NOASID=1.
+
+#define NPAGES   32       // pages in each working set
+#define NCALLS   200000   // system calls in the syscall test
+#define NSWITCH  20000    // round trips in the switch test
+
+char *ws;
+
+void touch(void) {
+    for (int i = 0; i < NPAGES; i++)
+        ws[i * PGSIZE]++;
+}
+
+
+// pass a byte back and forth, touching the working set each time.
+void pingpong(int in, int out, int first) {
+    char c = 0;
+
+    for (int i = 0; i < NSWITCH; i++) {
+        if (!first && read(in, &c, 1) != 1)
+            exit(1);
+        touch();
+        if (write(out, &c, 1) != 1)
+            exit(1);
+        if (first && read(in, &c, 1) != 1)
+            exit(1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int ab[2], ba[2];
+    uint64 start;
+    int pid, status;
+
+    ws = sbrk(NPAGES * PGSIZE);
+    if (ws == SBRK_ERROR) {
+        printf("switchbench: sbrk failed\n");
+        exit(1);
+    }
+    touch();
+
+    printf("=========================================\n");
+    printf("    TRAP AND SWITCH TLB BENCHMARK\n");
+    printf("=========================================\n");
+    printf("%d pages touched between operations\n\n", NPAGES);
+    printf("test\tops\tticks\tops/sec\n");
+
+    start = uptime();
+    for (int i = 0; i < NCALLS; i++) {
+        touch();
+        getpid();
+    }
+    report("syscall", NCALLS, uptime() - start);
+
+    if (pipe(ab) < 0 || pipe(ba) < 0) {
+        printf("switchbench: pipe failed\n");
+        exit(1);
+    }
+    start = uptime();
+    pid = fork();
+    if (pid < 0) {
+        printf("switchbench: fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        pingpong(ab[0], ba[1], 0);
+        exit(0);
+    }
+    pingpong(ba[0], ab[1], 1);
+    wait(&status);
+    if (status != 0) {
+        printf("switchbench: partner failed\n");
+        exit(1);
+    }
+    // each round trip is two switches.
+    report("switch", 2 * NSWITCH, uptime() - start);
+
+    printf("=========================================\n");
+    exit(0);
+}
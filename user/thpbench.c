@@ -0,0 +1,55 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "kernel/kalloc.h"
+#include "user/user.h"
+
+// Transparent huge page benchmark: fault in a large lazy heap
+// and walk over it, then report how many of the faults the
+// kernel could serve with 2 MiB pages.
+
+#define MB      (1024*1024)
+#define ROUNDS  4     // passes over the heap after faulting it in
+
+int main(int argc, char *argv[]) {
+    int mb = 32;
+    struct kmeminfo before, after;
+
+    if (argc > 1)
+        mb = atoi(argv[1]);
+
+    printf("=========================================\n");
+    printf("    TRANSPARENT HUGE PAGE BENCHMARK\n");
+    printf("=========================================\n");
+
+    kmeminfo(&before);
+    char *p = sbrklazy(mb * MB);
+    if (p == SBRK_ERROR) {
+        printf("thpbench: sbrklazy failed\n");
+        exit(1);
+    }
+
+    uint64 start_time = uptime();
+    for (uint64 i = 0; i < (uint64)mb * MB; i += PGSIZE)
+        p[i] = 1;
+    uint64 fault_ticks = uptime() - start_time;
+
+    start_time = uptime();
+    uint64 sum = 0;
+    for (int r = 0; r < ROUNDS; r++)
+        for (uint64 i = 0; i < (uint64)mb * MB; i += 64)
+            sum += p[i];
+    uint64 walk_ticks = uptime() - start_time;
+    kmeminfo(&after);
+
+    uint64 hits = after.nthpfault - before.nthpfault;
+    uint64 misses = after.nthpfallback - before.nthpfallback;
+    printf("%d MiB heap: fault-in %lu ticks, %d passes %lu ticks (sum %lu)\n",
+           mb, fault_ticks, ROUNDS, walk_ticks, sum);
+    printf("huge pages: %lu mapped, %lu fell back to 4 KiB, %lu split\n",
+           hits, misses, after.nthpsplit - before.nthpsplit);
+    if (hits + misses > 0)
+        printf("hit rate: %lu%%\n", hits * 100 / (hits + misses));
+    printf("=========================================\n");
+    exit(0);
+}
@@ -3,8 +3,18 @@
 #include "kernel/fcntl.h"
 #include "kernel/riscv.h"
 #include "kernel/vm.h"
+#include "kernel/param.h"
 #include "user/user.h"
 
+// memset(), memmove(), strlen() and strcmp() go a word at a
+// time where their arguments' alignment allows. An aligned
+// word never crosses a page boundary, so the string routines
+// may read a little past the terminating NUL.
+
+#define WORD sizeof(uint64)
+#define ALIGNED(p) (((uint64)(p) & (WORD - 1)) == 0)
+#define HASZERO(w) (((w) - 0x0101010101010101UL) & ~(w) & 0x8080808080808080UL)
+
 //
 // wrapper so that it's OK if main() does not call exit().
 //
@@ -31,6 +41,15 @@ strcpy(char *s, const char *t)
 int
 strcmp(const char *p, const char *q)
 {
+  if(((uint64)p & (WORD - 1)) == ((uint64)q & (WORD - 1))){
+    for(; !ALIGNED(p); p++, q++)
+      if(*p == 0 || *p != *q)
+        return (uchar)*p - (uchar)*q;
+    // skip equal words without a NUL; the loop below
+    // finds where the strings differ or end.
+    for(; *(uint64*)p == *(uint64*)q && !HASZERO(*(uint64*)p); p += WORD, q += WORD)
+      ;
+  }
   while(*p && *p == *q)
     p++, q++;
   return (uchar)*p - (uchar)*q;
@@ -39,21 +58,40 @@ strcmp(const char *p, const char *q)
 uint
 strlen(const char *s)
 {
-  int n;
+  const char *p = s;
+  const uint64 *w;
 
-  for(n = 0; s[n]; n++)
+  for(; !ALIGNED(p); p++)
+    if(*p == 0)
+      return p - s;
+  for(w = (const uint64*)p; !HASZERO(*w); w++)
     ;
-  return n;
+  for(p = (const char*)w; *p; p++)
+    ;
+  return p - s;
 }
 
 void*
 memset(void *dst, int c, uint n)
 {
   char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uint64 w, *wdst;
+
+  for(; n > 0 && !ALIGNED(cdst); n--)
+    *cdst++ = c;
+  w = (uchar)c * 0x0101010101010101UL;
+  wdst = (uint64 *) cdst;
+  for(; n >= 4*WORD; n -= 4*WORD, wdst += 4){
+    wdst[0] = w;
+    wdst[1] = w;
+    wdst[2] = w;
+    wdst[3] = w;
   }
+  for(; n >= WORD; n -= WORD)
+    *wdst++ = w;
+  cdst = (char *) wdst;
+  while(n-- > 0)
+    *cdst++ = c;
   return dst;
 }
 
@@ -112,20 +150,54 @@ atoi(const char *s)
 void*
 memmove(void *vdst, const void *vsrc, int n)
 {
-  char *dst;
-  const char *src;
-
-  dst = vdst;
-  src = vsrc;
-  if (src > dst) {
-    while(n-- > 0)
-      *dst++ = *src++;
-  } else {
-    dst += n;
-    src += n;
+  char *d = vdst;
+  const char *s = vsrc;
+
+  if(n <= 0)
+    return vdst;
+  if(s < d && s + n > d){
+    s += n;
+    d += n;
+    if(((uint64)s & (WORD - 1)) == ((uint64)d & (WORD - 1))){
+      for(; n > 0 && !ALIGNED(d); n--)
+        *--d = *--s;
+      for(; n >= WORD; n -= WORD){
+        d -= WORD;
+        s -= WORD;
+        *(uint64*)d = *(uint64*)s;
+      }
+    }
     while(n-- > 0)
-      *--dst = *--src;
+      *--d = *--s;
+    return vdst;
   }
+
+  for(; n > 0 && !ALIGNED(d); n--)
+    *d++ = *s++;
+  if(ALIGNED(s)){
+    for(; n >= 4*WORD; n -= 4*WORD, d += 4*WORD, s += 4*WORD){
+      ((uint64*)d)[0] = ((uint64*)s)[0];
+      ((uint64*)d)[1] = ((uint64*)s)[1];
+      ((uint64*)d)[2] = ((uint64*)s)[2];
+      ((uint64*)d)[3] = ((uint64*)s)[3];
+    }
+    for(; n >= WORD; n -= WORD, d += WORD, s += WORD)
+      *(uint64*)d = *(uint64*)s;
+  } else if(n >= WORD){
+    // read aligned words from s and shift each output word
+    // together from two of them. the last word read holds
+    // at least one byte that's needed, so is on a valid page.
+    int sh = ((uint64)s & (WORD - 1)) * 8;
+    const uint64 *ws = (const uint64*)((uint64)s & ~(WORD - 1));
+    uint64 lo = *ws++, hi;
+    for(; n >= WORD; n -= WORD, d += WORD, s += WORD){
+      hi = *ws++;
+      *(uint64*)d = (lo >> sh) | (hi << (64 - sh));
+      lo = hi;
+    }
+  }
+  while(n-- > 0)
+    *d++ = *s++;
   return vdst;
 }
 
@@ -159,3 +231,18 @@ sbrklazy(int n) {
   return sys_sbrk(n, SBRK_LAZY);
 }
 
+// For benchmarks: n things done in ticks uptime() ticks,
+// per second. No ticks at all counts as one.
+uint64
+persec(uint64 n, uint64 ticks)
+{
+  return n * TICKHZ / (ticks ? ticks : 1);
+}
+
+// Print a benchmark's result row: what was done, how many,
+// the ticks it took, and how many per second.
+void
+report(char *what, uint64 n, uint64 ticks)
+{
+  printf("%s\t%lu\t%lu\t%lu\n", what, n, ticks, persec(n, ticks));
+}
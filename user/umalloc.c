@@ -2,89 +2,215 @@
 #include "kernel/stat.h"
 #include "user/user.h"
 #include "kernel/param.h"
+#include "kernel/riscv.h"
+#include "kernel/mman.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Memory allocator with segregated size classes.
+//
+// Every block starts with a Header giving its size class.
+// Small blocks, of up to MAXSMALL bytes with their header,
+// are rounded up to one of the sizes in classsize[]. Each
+// class has a free list of its own, so malloc() and free()
+// only push or pop; blocks a class has never had are carved
+// off a CHUNK-sized bump region. Freed small blocks stay in
+// their class.
+//
+// Larger blocks take whole pages, from a list of free page
+// spans kept in address order, which coalesces neighbours
+// and is searched first fit. A freed large block of at least
+// RELEASEMIN bytes gives its pages, but for the one holding
+// the header, back to the kernel with madvise(MADV_DONTNEED);
+// they fault back in, zeroed, when the pages are used again.
+
+#define MAXSMALL   2048          // largest small block, header included
+#define CHUNK      (64*1024)     // bump region taken at a time
+#define MINGROW    16            // fewest pages to sbrk() at a time
+#define RELEASEMIN (64*1024)
+#define LARGE      0xff          // size class of large blocks
 
 typedef long Align;
 
 union header {
   struct {
-    union header *ptr;
-    uint size;
+    union header *next;   // next in a free list
+    uint npages;          // pages in a large block
+    uint class;           // index in classsize[], or LARGE
   } s;
   Align x;
 };
 
 typedef union header Header;
 
-static Header base;
-static Header *freep;
+// a free page span.
+struct span {
+  struct span *next;   // next higher free span
+  uint npages;
+};
+
+static ushort classsize[] = {
+  32, 48, 64, 80, 96, 128, 160, 192, 256, 320,
+  384, 512, 640, 768, 1024, 1280, 1536, 2048,
+};
+#define NCLASS (sizeof(classsize) / sizeof(classsize[0]))
+
+static uchar classof[MAXSMALL/16 + 1];  // class for each 16 bytes of size
+static Header *freelist[NCLASS];        // free small blocks of each class
+static char *bump, *bumpend;            // the bump region
+static struct span *spans;              // free page spans
+
+static void
+init(void)
+{
+  uint c = 0;
+
+  for(uint i = 0; i <= MAXSMALL/16; i++){
+    while(classsize[c] < i*16)
+      c++;
+    classof[i] = c;
+  }
+}
+
+// put the npages pages at sp on the span list,
+// merging them with their neighbours.
+static void
+pagefree(struct span *sp, uint npages)
+{
+  struct span *prev = 0, *next = spans;
+
+  for(; next && next < sp; prev = next, next = next->next)
+    ;
+  sp->npages = npages;
+  sp->next = next;
+  if(next && (char*)sp + (uint64)npages*PGSIZE == (char*)next){
+    sp->npages += next->npages;
+    sp->next = next->next;
+  }
+  if(prev && (char*)prev + (uint64)prev->npages*PGSIZE == (char*)sp){
+    prev->npages += sp->npages;
+    prev->next = sp->next;
+  } else if(prev){
+    prev->next = sp;
+  } else {
+    spans = sp;
+  }
+}
+
+// grow the heap by at least npages pages.
+static int
+morecore(uint npages)
+{
+  char *p;
+  uint64 pad;
+
+  if(npages < MINGROW)
+    npages = MINGROW;
+  // someone else may have left sbrk() off a page boundary.
+  p = sbrk(0);
+  if((pad = PGROUNDUP((uint64)p) - (uint64)p) != 0 && sbrk(pad) == SBRK_ERROR)
+    return -1;
+  p = sbrk(npages * PGSIZE);
+  if(p == SBRK_ERROR)
+    return -1;
+  pagefree((struct span*)p, npages);
+  return 0;
+}
+
+// allocate npages contiguous pages.
+static void*
+pagealloc(uint npages)
+{
+  struct span *sp, **pp;
+
+  for(;;){
+    for(pp = &spans; (sp = *pp) != 0; pp = &sp->next){
+      if(sp->npages == npages){
+        *pp = sp->next;
+        return sp;
+      }
+      if(sp->npages > npages){
+        // take the top, so the span stays where it is.
+        sp->npages -= npages;
+        return (char*)sp + (uint64)sp->npages*PGSIZE;
+      }
+    }
+    if(morecore(npages) < 0)
+      return 0;
+  }
+}
 
 void
 free(void *ap)
 {
-  Header *bp, *p;
+  Header *bp;
+  uint npages;
 
+  if(ap == 0)
+    return;
   bp = (Header*)ap - 1;
-  for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
-    if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
-      break;
-  if(bp + bp->s.size == p->s.ptr){
-    bp->s.size += p->s.ptr->s.size;
-    bp->s.ptr = p->s.ptr->s.ptr;
-  } else
-    bp->s.ptr = p->s.ptr;
-  if(p + p->s.size == bp){
-    p->s.size += bp->s.size;
-    p->s.ptr = bp->s.ptr;
-  } else
-    p->s.ptr = bp;
-  freep = p;
+  if(bp->s.class != LARGE){
+    bp->s.next = freelist[bp->s.class];
+    freelist[bp->s.class] = bp;
+    return;
+  }
+  npages = bp->s.npages;
+  if((uint64)npages*PGSIZE >= RELEASEMIN)
+    madvise((char*)bp + PGSIZE, (npages - 1)*PGSIZE, MADV_DONTNEED);
+  pagefree((struct span*)bp, npages);
 }
 
+// allocate a block of size class c.
 static Header*
-morecore(uint nu)
+smallalloc(uint c)
 {
-  char *p;
-  Header *hp;
+  Header *p;
+  uint sz = classsize[c];
 
-  if(nu < 4096)
-    nu = 4096;
-  p = sbrk(nu * sizeof(Header));
-  if(p == SBRK_ERROR)
-    return 0;
-  hp = (Header*)p;
-  hp->s.size = nu;
-  free((void*)(hp + 1));
-  return freep;
+  if((p = freelist[c]) != 0){
+    freelist[c] = p->s.next;
+    return p;
+  }
+  if(bumpend - bump < sz){
+    // hand what's left of the region to smaller classes.
+    for(int i = c - 1; i >= 0; i--){
+      while(bumpend - bump >= classsize[i]){
+        p = (Header*)bump;
+        p->s.class = i;
+        p->s.next = freelist[i];
+        freelist[i] = p;
+        bump += classsize[i];
+      }
+    }
+    if((bump = pagealloc(CHUNK / PGSIZE)) == 0){
+      bumpend = 0;
+      return 0;
+    }
+    bumpend = bump + CHUNK;
+  }
+  p = (Header*)bump;
+  bump += sz;
+  return p;
 }
 
 void*
 malloc(uint nbytes)
 {
-  Header *p, *prevp;
-  uint nunits;
+  Header *p;
+  uint64 n = (uint64)nbytes + sizeof(Header);
+  uint c;
 
-  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
-  if((prevp = freep) == 0){
-    base.s.ptr = freep = prevp = &base;
-    base.s.size = 0;
-  }
-  for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr){
-    if(p->s.size >= nunits){
-      if(p->s.size == nunits)
-        prevp->s.ptr = p->s.ptr;
-      else {
-        p->s.size -= nunits;
-        p += p->s.size;
-        p->s.size = nunits;
-      }
-      freep = prevp;
-      return (void*)(p + 1);
-    }
-    if(p == freep)
-      if((p = morecore(nunits)) == 0)
-        return 0;
+  if(classof[MAXSMALL/16] == 0)
+    init();
+  if(n <= MAXSMALL){
+    c = classof[(n + 15) / 16];
+    if((p = smallalloc(c)) == 0)
+      return 0;
+    p->s.class = c;
+    return (void*)(p + 1);
   }
+  n = PGROUNDUP(n) / PGSIZE;
+  if((p = pagealloc(n)) == 0)
+    return 0;
+  p->s.npages = n;
+  p->s.class = LARGE;
+  return (void*)(p + 1);
 }
@@ -1,6 +1,9 @@
 #define SBRK_ERROR ((char *)-1)
+#define MAP_FAILED ((void *)-1)
 
 struct stat;
+struct kmeminfo;
+struct slabinfo;
 
 // Type definitions for compatibility
 typedef unsigned int   uint;
@@ -17,6 +20,11 @@ struct procinfo {
   uint64 end_time;      // Time when process finished (0 if still running)
   uint64 first_run;     // Time when process was first scheduled
   uint64 total_wait;    // Total time spent waiting to be scheduled
+  uint64 rss;           // user pages mapped (resident)
+  uint64 nswapped;      // user pages swapped out
+  uint64 nptpages;      // page-table pages
+  uint64 nfault;        // page faults served
+  uint64 nmajfault;     // of those, read back in from swap
 };
 
 // system calls
@@ -39,8 +47,15 @@ int chdir(const char*);
 int dup(int);
 int getpid(void);
 char* sys_sbrk(int,int);
+int sys_fork(void);
+int sys_exit(int) __attribute__((noreturn));
+int sys_close(int);
+int sys_exec(const char*, char**);
 int pause(int);
 int uptime(void);
+void* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int madvise(void*, int, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -57,14 +72,20 @@ void *memcpy(void *, const void *, uint);
 char* sbrk(int);
 char* sbrklazy(int);
 int sleep(int ticks);
+uint64 persec(uint64, uint64);
+void report(char*, uint64, uint64);
 
 
 // my added function 
 int getprocinfo(int pid, struct procinfo *addr);
+int kmeminfo(struct kmeminfo*);
+int kmemdrain(struct kmeminfo*);
+int slabinfo(struct slabinfo*, int);
 
 // printf.c
 void fprintf(int, const char*, ...) __attribute__ ((format (printf, 2, 3)));
 void printf(const char*, ...) __attribute__ ((format (printf, 1, 2)));
+int fflush(int);
 
 // umalloc.c
 void* malloc(uint);
@@ -4,9 +4,11 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/mman.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/kalloc.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -2413,7 +2415,7 @@ stacktest(char *s)
   pid = fork();
   if(pid == 0) {
     char *sp = (char *) r_sp();
-    sp -= USERSTACK*PGSIZE;
+    sp -= USERSTACKMAX*PGSIZE;
     // the *sp should cause a trap.
     printf("%s: stacktest: read below stack %d\n", s, *sp);
     exit(1);
@@ -2428,6 +2430,53 @@ stacktest(char *s)
     exit(xstatus);
 }
 
+// fill 8 KiB of stack per call, n calls deep, and check
+// it on the way back up.
+int
+stackdeep(int n)
+{
+  volatile char buf[8192];
+  int sum;
+
+  for(int i = 0; i < sizeof(buf); i += 512)
+    buf[i] = n;
+  sum = n ? stackdeep(n - 1) : 0;
+  for(int i = 0; i < sizeof(buf); i += 512)
+    if(buf[i] != (char)n)
+      return -1000000;
+  return sum + n;
+}
+
+// the user stack grows on demand, up to USERSTACKMAX pages,
+// and a process that overflows it is killed.
+void
+stackgrow(char *s)
+{
+  int pid, xstatus;
+  int n = (USERSTACKMAX / 2) * PGSIZE / 8192;   // half the limit
+
+  if(stackdeep(n) != n * (n + 1) / 2){
+    printf("%s: deep stack went wrong\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    stackdeep(USERSTACKMAX * PGSIZE / 8192 + 1);
+    printf("%s: stack overflow not caught\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: overflowing child not killed\n", s);
+    exit(1);
+  }
+}
+
 // check that writes to a few forbidden addresses
 // cause a fault, e.g. process's text and TRAMPOLINE.
 void
@@ -2748,6 +2797,514 @@ lazy_sbrk(char *s)
   exit(0);
 }
 
+// anonymous mappings are zero-filled, writable, and
+// can be unmapped a piece at a time.
+void
+mmapanon(char *s)
+{
+  char *p = mmap(0, 4*PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(p == MAP_FAILED){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < 4*PGSIZE; i += 512){
+    if(p[i] != 0){
+      printf("%s: mapping not zero-filled\n", s);
+      exit(1);
+    }
+    p[i] = i / 512;
+  }
+
+  // punch a hole, then remove the rest from both ends.
+  if(munmap(p + PGSIZE, PGSIZE) < 0){
+    printf("%s: munmap of middle page failed\n", s);
+    exit(1);
+  }
+  if(p[0] != 0 || p[2*PGSIZE] != 2*PGSIZE/512 || p[3*PGSIZE] != 3*PGSIZE/512){
+    printf("%s: munmap disturbed the other pages\n", s);
+    exit(1);
+  }
+  if(munmap(p + PGSIZE, PGSIZE) == 0){
+    printf("%s: munmap of a hole succeeded\n", s);
+    exit(1);
+  }
+  if(munmap(p, PGSIZE) < 0 || munmap(p + 2*PGSIZE, 2*PGSIZE) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+
+  // the heap must not grow into a mapping.
+  p = mmap(0, PGSIZE, PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(p == MAP_FAILED){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  if(sbrklazy(p - sbrk(0) + 1) != SBRK_ERROR){
+    printf("%s: sbrk grew into a mapping\n", s);
+    exit(1);
+  }
+  munmap(p, PGSIZE);
+}
+
+// private file mappings see the file but don't change it;
+// shared ones write dirty pages back when unmapped.
+void
+mmapfile(char *s)
+{
+  char *file = "mmapfile";
+  int n = 2*PGSIZE + 100;
+  int fd;
+  char *p;
+
+  unlink(file);
+  fd = open(file, O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < n; i++){
+    char c = 'a' + i % 26;
+    if(write(fd, &c, 1) != 1){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+
+  p = mmap(0, 3*PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == MAP_FAILED){
+    printf("%s: mmap private failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < 3*PGSIZE; i++){
+    if(p[i] != (i < n ? 'a' + i % 26 : 0)){
+      printf("%s: wrong byte %d in private mapping\n", s, i);
+      exit(1);
+    }
+  }
+  p[0] = 'X';
+  munmap(p, 3*PGSIZE);
+
+  p = mmap(0, n, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == MAP_FAILED){
+    printf("%s: mmap shared failed\n", s);
+    exit(1);
+  }
+  if(p[0] != 'a'){
+    printf("%s: private mapping changed the file\n", s);
+    exit(1);
+  }
+  p[0] = 'Y';
+  p[PGSIZE] = 'Z';
+  // read() into the mapping dirties it too.
+  char hello[] = "hello";
+  int wfd = open(file, O_RDONLY);
+  if(wfd < 0 || read(wfd, p + 2*PGSIZE, 1) != 1){
+    printf("%s: read into mapping failed\n", s);
+    exit(1);
+  }
+  close(wfd);
+  memmove(p + n - sizeof(hello), hello, sizeof(hello));
+  munmap(p, n);
+  close(fd);
+
+  fd = open(file, O_RDONLY);
+  if(read(fd, buf, n) != n || buf[0] != 'Y' || buf[PGSIZE] != 'Z' ||
+     buf[2*PGSIZE] != 'a' || strcmp(buf + n - sizeof(hello), hello) != 0){
+    printf("%s: shared writes not written back\n", s);
+    exit(1);
+  }
+  struct stat st;
+  if(fstat(fd, &st) < 0 || st.size != n){
+    printf("%s: write-back changed the file size\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // a read-only file can't be mapped shared and writable.
+  fd = open(file, O_RDONLY);
+  if(mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0) != MAP_FAILED){
+    printf("%s: writable shared mapping of read-only file\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink(file);
+}
+
+// a forked child shares its parent's shared mappings,
+// and gets its own copy of private ones.
+void
+mmapfork(char *s)
+{
+  char *sh = mmap(0, 2*PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  char *pr = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(sh == MAP_FAILED || pr == MAP_FAILED){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  pr[0] = 1;
+
+  int pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    sh[0] = 2;
+    sh[PGSIZE] = 3;  // never touched by the parent
+    pr[0] = 4;
+    exit(0);
+  }
+  int xstatus;
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  if(sh[0] != 2 || sh[PGSIZE] != 3){
+    printf("%s: child's writes to shared mapping not seen\n", s);
+    exit(1);
+  }
+  if(pr[0] != 1){
+    printf("%s: child's write to private mapping seen\n", s);
+    exit(1);
+  }
+}
+
+// read(), write() to a pipe, and wait() copying to or from pages
+// of a file mapping that aren't faulted in yet. the faults read
+// the file, and must not happen under the kernel's locks; a
+// read() of a file into its own mapping used to deadlock.
+void
+copyfault(char *s)
+{
+  char *file = "copyfault";
+  int fd, fds[2], xstatus;
+  char *p;
+
+  unlink(file);
+  fd = open(file, O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < 4; i++){
+    memset(buf, 'a' + i, PGSIZE);
+    if(write(fd, buf, PGSIZE) != PGSIZE){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  p = mmap(0, 4*PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == MAP_FAILED){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+
+  // the same block of the same file.
+  int rfd = open(file, O_RDONLY);
+  if(rfd < 0 || read(rfd, p, 100) != 100 || p[0] != 'a'){
+    printf("%s: read into own mapping failed\n", s);
+    exit(1);
+  }
+  close(rfd);
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(write(fds[1], p + PGSIZE, 300) != 300 ||
+     read(fds[0], p + 2*PGSIZE + 10, 300) != 300 ||
+     p[2*PGSIZE + 10] != 'b' || p[2*PGSIZE + 309] != 'b' ||
+     p[2*PGSIZE + 310] != 'c'){
+    printf("%s: pipe to or from mapping failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  int pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(7);
+  if(wait((int*)(p + 3*PGSIZE)) != pid || *(int*)(p + 3*PGSIZE) != 7){
+    printf("%s: wait into mapping failed\n", s);
+    exit(1);
+  }
+  if(wait(&xstatus) != -1){
+    printf("%s: extra child\n", s);
+    exit(1);
+  }
+
+  munmap(p, 4*PGSIZE);
+  close(fd);
+  unlink(file);
+}
+
+// a big lazily grown heap may get 2 MiB pages; shrinking it to
+// the middle of one, and forking, must split them and keep the
+// data intact.
+void
+thpsplit(char *s)
+{
+  int n = 8*1024*1024;
+  char *p = sbrklazy(n);
+  if(p == SBRK_ERROR){
+    printf("%s: sbrklazy failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < n; i += PGSIZE)
+    p[i] = i / PGSIZE;
+
+  int shrink = 3*1024*1024 + 5*PGSIZE;
+  if(sbrk(-shrink) == SBRK_ERROR){
+    printf("%s: sbrk shrink failed\n", s);
+    exit(1);
+  }
+  n -= shrink;
+  for(int i = 0; i < n; i += PGSIZE){
+    if(p[i] != (char)(i / PGSIZE)){
+      printf("%s: wrong data at %d after shrink\n", s, i);
+      exit(1);
+    }
+  }
+
+  int pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(int i = 0; i < n; i += PGSIZE){
+      if(p[i] != (char)(i / PGSIZE)){
+        printf("%s: wrong data at %d in child\n", s, i);
+        exit(1);
+      }
+      p[i] = 0;
+    }
+    exit(0);
+  }
+  int xstatus;
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  for(int i = 0; i < n; i += PGSIZE){
+    if(p[i] != (char)(i / PGSIZE)){
+      printf("%s: child's write seen at %d\n", s, i);
+      exit(1);
+    }
+  }
+}
+
+// reading untouched heap maps a shared page of zeros; writes,
+// by the process or by the kernel for it, must get a private
+// copy, and must not show through in a forked child or parent.
+void
+lazyzero(char *s)
+{
+  int n = 4*1024*1024;
+  int fds[2];
+  char *p = sbrklazy(n);
+  if(p == SBRK_ERROR){
+    printf("%s: sbrklazy failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < n; i += PGSIZE){
+    if(p[i] != 0 || p[i + PGSIZE - 1] != 0){
+      printf("%s: non-zero read at %d\n", s, i);
+      exit(1);
+    }
+  }
+  for(int i = 0; i < n; i += 2*PGSIZE)
+    p[i] = 1;
+  for(int i = 0; i < n; i += PGSIZE){
+    if(p[i] != ((i / PGSIZE) % 2 == 0)){
+      printf("%s: wrong data at %d after write\n", s, i);
+      exit(1);
+    }
+  }
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(write(fds[1], "x", 1) != 1 || read(fds[0], p + PGSIZE, 1) != 1){
+    printf("%s: pipe read into zero page failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  if(p[PGSIZE] != 'x' || p[3*PGSIZE] != 0){
+    printf("%s: read() into zero page went wrong\n", s);
+    exit(1);
+  }
+
+  int pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(int i = 3*PGSIZE; i < n; i += 2*PGSIZE)
+      p[i] = 2;
+    exit(0);
+  }
+  int xstatus;
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  for(int i = 3*PGSIZE; i < n; i += 2*PGSIZE){
+    if(p[i] != 0){
+      printf("%s: child's write seen at %d\n", s, i);
+      exit(1);
+    }
+  }
+  sbrk(-n);
+}
+
+// madvise(MADV_DONTNEED) must bring pages back as they were
+// first: zeroed in the heap, from the file in a private file
+// mapping. it must refuse ranges that aren't the process's,
+// and shared anonymous pages, which would be lost.
+void
+madvisetest(char *s)
+{
+  char *file = "madvisetest";
+  int n = 8*PGSIZE;
+  int fd;
+  char *p, *m;
+  struct kmeminfo before, after;
+
+  p = sbrk(n);
+  if(p == SBRK_ERROR){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  memset(p, 1, n);
+  if(madvise(p + 2*PGSIZE, 4*PGSIZE, MADV_DONTNEED) < 0){
+    printf("%s: madvise heap failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < n; i += PGSIZE/2){
+    if(p[i] != (i >= 2*PGSIZE && i < 6*PGSIZE ? 0 : 1)){
+      printf("%s: wrong byte %d after MADV_DONTNEED\n", s, i);
+      exit(1);
+    }
+  }
+  if(madvise(p, n, MADV_WILLNEED) < 0 || p[3*PGSIZE] != 0){
+    printf("%s: madvise WILLNEED failed\n", s);
+    exit(1);
+  }
+  if(madvise(p + 1, PGSIZE, MADV_DONTNEED) == 0 ||
+     madvise(p, PGSIZE, 99) == 0 ||
+     madvise(sbrk(0), PGSIZE, MADV_DONTNEED) == 0 ||
+     madvise(p + n - PGSIZE, 2*PGSIZE, MADV_WILLNEED) == 0 ||
+     madvise((char*)KERNBASE, PGSIZE, MADV_DONTNEED) == 0){
+    printf("%s: madvise of a bad range succeeded\n", s);
+    exit(1);
+  }
+  sbrk(-n);
+
+  unlink(file);
+  fd = open(file, O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  memset(p = malloc(PGSIZE), 'x', PGSIZE);
+  for(int i = 0; i < 2; i++){
+    if(write(fd, p, PGSIZE) != PGSIZE){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  free(p);
+  m = mmap(0, 2*PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(m == MAP_FAILED){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  m[0] = m[PGSIZE] = 'y';
+  if(madvise(m, 2*PGSIZE, MADV_DONTNEED) < 0 || m[0] != 'x' || m[PGSIZE] != 'x'){
+    printf("%s: private file page not read back\n", s);
+    exit(1);
+  }
+  munmap(m, 2*PGSIZE);
+  close(fd);
+  unlink(file);
+
+  m = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if(m == MAP_FAILED){
+    printf("%s: mmap shared failed\n", s);
+    exit(1);
+  }
+  m[0] = 'z';
+  if(madvise(m, PGSIZE, MADV_DONTNEED) == 0 || m[0] != 'z'){
+    printf("%s: shared anonymous page dropped\n", s);
+    exit(1);
+  }
+  munmap(m, PGSIZE);
+
+  // malloc() gives a big freed block back.
+  n = 1024*1024;
+  p = malloc(n);
+  if(p == 0){
+    printf("%s: malloc failed\n", s);
+    exit(1);
+  }
+  memset(p, 1, n);
+  kmeminfo(&before);
+  free(p);
+  kmeminfo(&after);
+  if(after.nfree < before.nfree + n/PGSIZE/2){
+    printf("%s: free() gave back %d pages of %d\n", s,
+           (int)(after.nfree - before.nfree), n/PGSIZE);
+    exit(1);
+  }
+}
+
+// getprocinfo() must count the pages a process touches,
+// the faults that brought them in, and its page tables.
+void
+procmem(char *s)
+{
+  int n = 64*PGSIZE;
+  struct procinfo before, after;
+  char *p;
+
+  if(getprocinfo(getpid(), &before) < 0){
+    printf("%s: getprocinfo failed\n", s);
+    exit(1);
+  }
+  if(before.rss == 0 || before.nptpages < 3){
+    printf("%s: rss %d, %d page-table pages\n", s, (int)before.rss, (int)before.nptpages);
+    exit(1);
+  }
+  p = sbrklazy(n);
+  if(p == SBRK_ERROR){
+    printf("%s: sbrklazy failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < n; i += PGSIZE)
+    p[i] = 1;
+  getprocinfo(getpid(), &after);
+  if(after.rss < before.rss + n/PGSIZE || after.nfault < before.nfault + 1){
+    printf("%s: rss %d -> %d, faults %d -> %d\n", s, (int)before.rss, (int)after.rss,
+           (int)before.nfault, (int)after.nfault);
+    exit(1);
+  }
+  sbrk(-n);
+  getprocinfo(getpid(), &after);
+  if(after.rss > before.rss + 1){
+    printf("%s: rss %d after sbrk(-n), was %d\n", s, (int)after.rss, (int)before.rss);
+    exit(1);
+  }
+  if(getprocinfo(-1, &after) == 0){
+    printf("%s: getprocinfo of pid -1 succeeded\n", s);
+    exit(1);
+  }
+}
+
 struct test {
   void (*f)(char *);
   char *s;
@@ -2806,6 +3363,7 @@ struct test {
   {bigargtest, "bigargtest"},
   {argptest, "argptest"},
   {stacktest, "stacktest"},
+  {stackgrow, "stackgrow"},
   {nowrite, "nowrite"},
   {pgbug, "pgbug" },
   {sbrkbugs, "sbrkbugs" },
@@ -2816,6 +3374,14 @@ struct test {
   {lazy_unmap, "lazy_unmap"},
   {lazy_copy, "lazy_copy"},
   {lazy_sbrk, "lazy_sbrk"},
+  {mmapanon, "mmapanon"},
+  {mmapfile, "mmapfile"},
+  {mmapfork, "mmapfork"},
+  {copyfault, "copyfault"},
+  {thpsplit, "thpsplit"},
+  {lazyzero, "lazyzero"},
+  {madvisetest, "madvisetest"},
+  {procmem, "procmem"},
   { 0, 0},
 };
 
@@ -9,7 +9,8 @@ print "#include \"kernel/syscall.h\"\n";
 sub entry {
     my $prefix = "sys_";
     my $name = shift;
-    if ($name eq "sbrk") {
+    # these have wrappers in ulib.c or printf.c.
+    if ($name =~ /^(sbrk|fork|exit|close|exec)$/) {
 	print ".global $prefix$name\n";
 	print "$prefix$name:\n";
     } else {
@@ -45,4 +46,10 @@ entry("uptime");
 entry("sleep");
 
 # My added function 
-entry("getprocinfo");
\ No newline at end of file
+entry("getprocinfo");
+entry("kmeminfo");
+entry("slabinfo");
+entry("mmap");
+entry("munmap");
+entry("madvise");
+entry("kmemdrain");
\ No newline at end of file